@@ -3,11 +3,17 @@
 #include "bench/key_generator.h"
 #include "bench/value_generator.h"
 #include "index/interface.h"
+#include "index/hot_cache.h"
+#include "index/bloom_filter.h"
+#include "index/frozen_index.h"
+#include "index/cuckoo_filter.h"
+#include "index/clock_cache.h"
 #include "util/pair.h"
 #include "util/config.h"
 #include "pcm/cpucounters.h"
 
 #include <iostream>
+#include <atomic>
 #include <cstdint>
 #include <memory>
 #include <vector>
@@ -62,12 +68,43 @@ class benchmark_t{
 	Hash<Key_t>* hashtable;
 	PCM* pcm;
 
+	size_t batch_size = 1; // > 1: YCSB load goes through InsertBatch
+	bool bulk_load = false; // YCSB load goes through BulkLoad
+	bool presize = false; // Reserve room for the load before it starts instead of growing the table
+
+	bool virtual_dispatch = false; // run the benchmark loops through the Hash<Key_t> vtable
+	bool hot_cache = false; // put a per-thread HotCache in front of the index and report its hit rate
+	size_t bloom_keys = 0; // > 0: put a BloomFilter sized for this many keys in front of the index
+	int miss_ratio = 0; // percent of microbench searches for keys that are not in the index
+	bool freeze = false; // Freeze() the index between the YCSB load and a read-only run
+	FrozenIndex<Key_t>* frozen_index = nullptr; // set by dispatch while it runs with freeze
+
 	size_t mem_usage(void);
+	template <typename Fn>
+	inline void dispatch(int index_type, Fn&& fn);
 	inline void utilization(int index_type, Pair<Key_t>* init_kv, int init_num);
 	inline void microbench(int index_type, Pair<Key_t>* init_kv, int init_num, bool insert_only);
 	inline void mixed(int index_type, Pair<Key_t>* init_kv, int init_num, int num_threads);
 	inline void latency(int index_type, Pair<Key_t>* init_kv, int init_num, int num_threads);
+	inline void interleave(int index_type, Pair<Key_t>* init_kv, int init_num, int num_threads);
+	inline void scan(int index_type, Pair<Key_t>* init_kv, int init_num, int num_threads);
+	inline void filter(Pair<Key_t>* init_kv, int init_num, int num_threads);
+	inline void cache(Pair<Key_t>* init_kv, int init_num, int num_threads);
 	inline void ycsb_load(int workload_type, int index_type, Pair<Key_t>* init_kv, int init_num, Pair<Key_t>* run_kv, int run_num, int* ops);
 	inline void ycsb_exec(int workload_type, int index_type, Pair<Key_t>* init_kv, int init_num, Pair<Key_t>* run_kv, int run_num, int num_threads, int* ops, bool pcm_nabled);
+	template <typename Index>
+	inline void microbench(Index* hashtable, Pair<Key_t>* init_kv, int init_num, bool insert_only);
+	template <typename Index>
+	inline void mixed(Index* hashtable, Pair<Key_t>* init_kv, int init_num, int num_threads);
+	template <typename Index>
+	inline void latency(Index* hashtable, Pair<Key_t>* init_kv, int init_num, int num_threads);
+	template <typename Index>
+	inline void interleave(Index* hashtable, Pair<Key_t>* init_kv, int init_num, int num_threads);
+	template <typename Index>
+	inline void scan(Index* hashtable, Pair<Key_t>* init_kv, int init_num, int num_threads);
+	template <typename Fp_t>
+	inline void filter(Pair<Key_t>* init_kv, Pair<Key_t>* miss_kv, int init_num, int num_threads);
+	template <typename Index>
+	inline void ycsb_exec(Index* hashtable, int workload_type, Pair<Key_t>* init_kv, int init_num, Pair<Key_t>* run_kv, int run_num, int num_threads, int* ops, bool pcm_enabled);
     private:
 };
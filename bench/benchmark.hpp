@@ -23,6 +23,48 @@ size_t benchmark_t<Key_t>::mem_usage(void){
     return rss * (4096 / 1024); // in KiB
 }
 
+/* Runs fn(hashtable) on a freshly created index of the given type.
+ * fn is a generic lambda, so every benchmark loop is instantiated once per concrete engine and
+ * the engine calls in it are resolved (and inlined) at compile time. With virtual_dispatch the
+ * loops run against Hash<Key_t> instead and every operation goes through the vtable, as they do
+ * with a HotCache, BloomFilter or FrozenIndex in front of the engine. */
+template <typename Key_t>
+template <typename Fn>
+inline void benchmark_t<Key_t>::dispatch(int index_type, Fn&& fn){
+    if(hot_cache || bloom_keys || freeze){
+	/* the wrappers call the engine through the vtable and the loops run against Hash<Key_t>, as with virtual_dispatch */
+	Hash<Key_t>* hashtable = getInstance<Key_t>(index_type);
+	std::unique_ptr<BloomFilter<Key_t>> filter;
+	std::unique_ptr<FrozenIndex<Key_t>> frozen;
+	std::unique_ptr<HotCache<Key_t>> cache;
+	if(bloom_keys){
+	    filter = std::make_unique<BloomFilter<Key_t>>(hashtable, bloom_keys);
+	    hashtable = filter.get();
+	}
+	if(freeze){
+	    frozen = std::make_unique<FrozenIndex<Key_t>>(hashtable);
+	    hashtable = frozen_index = frozen.get();
+	}
+	if(hot_cache){
+	    cache = std::make_unique<HotCache<Key_t>>(hashtable);
+	    hashtable = cache.get();
+	}
+	fn(hashtable);
+	frozen_index = nullptr;
+	if(filter)
+	    std::cout << "BloomFilter: " << filter->Filtered() << " operations answered by the filter" << std::endl;
+	if(cache)
+	    std::cout << "HotCache hit rate: " << cache->HitRate() << " % (" << cache->Hits() << " of " << cache->Lookups() << " lookups)" << std::endl;
+	return;
+    }
+    if(virtual_dispatch){
+	Hash<Key_t>* hashtable = getInstance<Key_t>(index_type);
+	fn(hashtable);
+	return;
+    }
+    std::visit([&fn](auto* hashtable){ fn(hashtable); }, getEngine<Key_t>(index_type));
+}
+
 template <typename Key_t>
 inline void benchmark_t<Key_t>::utilization(int index_type, Pair<Key_t>* init_kv, int init_num){
     gen_input(init_kv, init_num);
@@ -53,7 +95,14 @@ inline void benchmark_t<Key_t>::utilization(int index_type, Pair<Key_t>* init_kv
 
 template <typename Key_t>
 inline void benchmark_t<Key_t>::latency(int index_type, Pair<Key_t>* init_kv, int init_num, int num_threads){
-    Hash<Key_t>* hashtable = getInstance<Key_t>(index_type);
+    dispatch(index_type, [&](auto* hashtable){
+	latency(hashtable, init_kv, init_num, num_threads);
+    });
+}
+
+template <typename Key_t>
+template <typename Index>
+inline void benchmark_t<Key_t>::latency(Index* hashtable, Pair<Key_t>* init_kv, int init_num, int num_threads){
     gen_input(init_kv, init_num);
     std::random_shuffle(init_kv, init_kv+init_num);
     
@@ -103,7 +152,14 @@ inline void benchmark_t<Key_t>::latency(int index_type, Pair<Key_t>* init_kv, in
 
 template <typename Key_t>
 inline void benchmark_t<Key_t>::mixed(int index_type, Pair<Key_t>* init_kv, int init_num, int num_threads){
-    Hash<Key_t>* hashtable = getInstance<Key_t>(index_type);
+    dispatch(index_type, [&](auto* hashtable){
+	mixed(hashtable, init_kv, init_num, num_threads);
+    });
+}
+
+template <typename Key_t>
+template <typename Index>
+inline void benchmark_t<Key_t>::mixed(Index* hashtable, Pair<Key_t>* init_kv, int init_num, int num_threads){
     gen_input(init_kv, init_num);
     std::random_shuffle(init_kv, init_kv+init_num);
 
@@ -134,8 +190,9 @@ inline void benchmark_t<Key_t>::mixed(int index_type, Pair<Key_t>* init_kv, int
 		insert_idx += 1000;
 	    }
 	    else if(r < insert_ratio+search_ratio){
+		default_value v;
 		for(int j=search_idx; j<search_idx+1000; j++)
-		    auto ret = hashtable->Get(init_kv[j].key);
+		    auto ret = hashtable->Get(init_kv[j].key, v);
 		search_idx += 1000;
 	    }
 	    else if(r < insert_ratio+search_ratio+update_ratio){
@@ -162,9 +219,167 @@ inline void benchmark_t<Key_t>::mixed(int index_type, Pair<Key_t>* init_kv, int
     std::cout << "Insert(10%), Search(50%), Delete(10%), Update(25%)" << std::endl;
 }
 
+template <typename Key_t>
+inline void benchmark_t<Key_t>::interleave(int index_type, Pair<Key_t>* init_kv, int init_num, int num_threads){
+    dispatch(index_type, [&](auto* hashtable){
+	interleave(hashtable, init_kv, init_num, num_threads);
+    });
+}
+
+template <typename Key_t>
+template <typename Index>
+inline void benchmark_t<Key_t>::interleave(Index* hashtable, Pair<Key_t>* init_kv, int init_num, int num_threads){
+    gen_input(init_kv, init_num);
+    std::random_shuffle(init_kv, init_kv+init_num);
+    for(int i=0; i<init_num; i++){
+	hashtable->Insert(init_kv[i].key, init_kv[i].value);
+    }
+
+    /* depth 0 is the plain synchronous Get, the rest run GetCoro with that many lookups in flight per thread */
+    std::vector<size_t> depths = {0, 1, 2, 4, 8, 16, 32};
+    for(auto depth: depths){
+	std::vector<int> failed(num_threads);
+	auto search_func = [&hashtable, &init_kv, init_num, num_threads, depth, &failed](uint64_t thread_id, bool){
+	    size_t chunk = init_num / num_threads;
+	    size_t from = chunk * thread_id;
+	    size_t to = chunk * (thread_id+1);
+	    int fail = 0;
+	    if(depth == 0){
+		default_value v;
+		for(size_t i=from; i<to; i++){
+		    if(!hashtable->Get(init_kv[i].key, v) || !(v == init_kv[i].value)) fail++;
+		}
+	    }
+	    else{
+		/* every in-flight lookup copies its value to a buffer of its own, released when it completes */
+		std::vector<default_value> vals(depth);
+		std::vector<size_t> buf(to - from), free_bufs;
+		for(size_t b=0; b<depth; b++)
+		    free_bufs.push_back(b);
+		::interleave<bool>(to - from, depth,
+			[&](size_t i){
+			    buf[i] = free_bufs.back();
+			    free_bufs.pop_back();
+			    return hashtable->GetCoro(init_kv[from+i].key, vals[buf[i]]);
+			},
+			[&](size_t i, bool found){
+			    if(!found || !(vals[buf[i]] == init_kv[from+i].value)) fail++;
+			    free_bufs.push_back(buf[i]);
+			});
+	    }
+	    failed[thread_id] = fail;
+	};
+
+	clear_cache();
+	double start_time = get_now();
+	start_threads(hashtable, num_threads, search_func, false);
+	double end_time = get_now();
+
+	int fail = 0;
+	for(auto& it: failed) fail += it;
+	double throughput = (init_num / num_threads * num_threads) / (end_time - start_time) / 1000000; // MOps/sec
+	std::cout << "\033[1;32m";
+	if(depth == 0)
+	    std::cout << "Get";
+	else
+	    std::cout << "GetCoro(depth " << depth << ")";
+	std::cout << " Throughput(MOps/sec): " << throughput << "\033[0m";
+	if(fail)
+	    std::cout << "\tfailed: " << fail;
+	std::cout << std::endl;
+    }
+}
+
+template <typename Key_t>
+inline void benchmark_t<Key_t>::scan(int index_type, Pair<Key_t>* init_kv, int init_num, int num_threads){
+    dispatch(index_type, [&](auto* hashtable){
+	scan(hashtable, init_kv, init_num, num_threads);
+    });
+}
+
+template <typename Key_t>
+template <typename Index>
+inline void benchmark_t<Key_t>::scan(Index* hashtable, Pair<Key_t>* init_kv, int init_num, int num_threads){
+    gen_input(init_kv, init_num);
+    std::random_shuffle(init_kv, init_kv+init_num);
+    for(int i=0; i<init_num; i++){
+	hashtable->Insert(init_kv[i].key, init_kv[i].value);
+    }
+
+    std::atomic<size_t> count(0), sum(0);
+    clear_cache();
+    double start_time = get_now();
+    hashtable->ForEach([&count, &sum](const Pair<Key_t>* kv, size_t num){
+	    size_t _sum = 0;
+	    for(size_t i=0; i<num; i++)
+		_sum += (int64_t)kv[i].value;
+	    count += num;
+	    sum += _sum;
+	}, num_threads);
+    double end_time = get_now();
+
+    size_t expected = 0;
+    for(int i=0; i<init_num; i++)
+	expected += (int64_t)init_kv[i].value;
+    double throughput = count / (end_time - start_time) / 1000000; // MOps/sec
+    std::cout << "\033[1;32m";
+    std::cout << "Scan Throughput(MOps/sec): " << throughput << "\033[0m";
+    if(count != (size_t)init_num || sum != expected)
+	std::cout << "\tscanned " << count << " pairs of " << init_num;
+    std::cout << std::endl;
+}
+
+/* CuckooFilter on its own: Add, Contains of every added key and of as many keys that were never added,
+ * and Remove, with 8- and 16-bit fingerprints */
+template <typename Key_t>
+inline void benchmark_t<Key_t>::filter(Pair<Key_t>* init_kv, int init_num, int num_threads){
+    gen_input(init_kv, init_num);
+    std::random_shuffle(init_kv, init_kv+init_num);
+    std::vector<Pair<Key_t>> miss_kv(init_num);
+    gen_misses(miss_kv.data(), init_num, init_num);
+    filter<uint8_t>(init_kv, miss_kv.data(), init_num, num_threads);
+    filter<uint16_t>(init_kv, miss_kv.data(), init_num, num_threads);
+}
+
+template <typename Key_t>
+template <typename Fp_t>
+inline void benchmark_t<Key_t>::filter(Pair<Key_t>* init_kv, Pair<Key_t>* miss_kv, int init_num, int num_threads){
+    CuckooFilter<Key_t, Fp_t> cf(init_num);
+    std::atomic<size_t> failed(0), negatives(0), positives(0), removed(0);
+    auto run = [&](const char* op, Pair<Key_t>* kv, auto&& fn){
+	double start_time = get_now();
+	parallel_run(num_threads, [&](size_t tid){
+		size_t from = (size_t)init_num*tid/num_threads, to = (size_t)init_num*(tid+1)/num_threads;
+		for(size_t i=from; i<to; i++)
+		    fn(kv[i].key);
+	    });
+	double end_time = get_now();
+	std::cout << "\033[1;32m" << op << " Throughput(MOps/sec): " << init_num / (end_time - start_time) / 1000000 << "\033[0m" << std::endl;
+    };
+
+    std::cout << 8*sizeof(Fp_t) << "-bit fingerprints" << std::endl;
+    clear_cache();
+    run("Add", init_kv, [&](Key_t& key){ if(!cf.Add(key)) failed++; });
+    auto load = cf.Utilization();
+    run("Contains(added)", init_kv, [&](Key_t& key){ if(!cf.Contains(key)) negatives++; });
+    run("Contains(not added)", miss_kv, [&](Key_t& key){ if(cf.Contains(key)) positives++; });
+    run("Remove", init_kv, [&](Key_t& key){ if(cf.Remove(key)) removed++; });
+
+    std::cout << "bits/key: " << (double)cf.Bytes()*8/init_num << ", load: " << load << " %, false positive rate: " << positives*100.0/init_num << " %" << std::endl;
+    if(failed || negatives || removed != (size_t)init_num - failed)
+	std::cout << "failed adds: " << failed << ", false negatives: " << negatives << ", removed: " << removed << std::endl;
+}
+
 template <typename Key_t>
 inline void benchmark_t<Key_t>::microbench(int index_type, Pair<Key_t>* init_kv, int init_num, bool insert_only){
-    Hash<Key_t>* hashtable = getInstance<Key_t>(index_type);
+    dispatch(index_type, [&](auto* hashtable){
+	microbench(hashtable, init_kv, init_num, insert_only);
+    });
+}
+
+template <typename Key_t>
+template <typename Index>
+inline void benchmark_t<Key_t>::microbench(Index* hashtable, Pair<Key_t>* init_kv, int init_num, bool insert_only){
     gen_input(init_kv, init_num);
     /*
     if constexpr(sizeof(Key_t) > 8){
@@ -176,6 +391,8 @@ inline void benchmark_t<Key_t>::microbench(int index_type, Pair<Key_t>* init_kv,
 	}
     }*/
     std::random_shuffle(init_kv, init_kv+init_num);
+    if(presize)
+	hashtable->Reserve(init_num);
     clear_cache();
     struct timespec start, end;
     clock_gettime(CLOCK_MONOTONIC, &start);
@@ -196,17 +413,34 @@ inline void benchmark_t<Key_t>::microbench(int index_type, Pair<Key_t>* init_kv,
     if(insert_only)
 	return;
 
+    /* miss_ratio percent of the searches, spread evenly, look for keys that were never inserted */
+    std::vector<Pair<Key_t>> search_kv(init_kv, init_kv+init_num);
+    if(miss_ratio > 0){
+	std::vector<Pair<Key_t>> miss_kv(init_num);
+	gen_misses(miss_kv.data(), init_num, init_num);
+	for(int i=0; i<init_num; i++){
+	    if(i % 100 < miss_ratio){
+		search_kv[i] = miss_kv[i];
+		search_kv[i].value = 0;
+	    }
+	}
+    }
+
     clear_cache();
     clock_gettime(CLOCK_MONOTONIC, &start);
+    default_value v;
     for(int i=0; i<init_num; i++){
-	auto ret = hashtable->Get(init_kv[i].key);
-	assert((uint64_t)ret == init_kv[i].value);
+	auto ret = hashtable->Get(search_kv[i].key, v);
+	assert(ret ? v == search_kv[i].value : search_kv[i].value == 0);
     }
     clock_gettime(CLOCK_MONOTONIC, &end);
     elapsed = end.tv_nsec - start.tv_nsec + (end.tv_sec - start.tv_sec)*1000000000;
     throughput = (uint64_t)init_num / (elapsed/1000.0) * 1000000;
     std::cout << "\033[1;32m";
-    std::cout << "Search Throughput(Ops/sec): " << throughput << "\033[0m" << std::endl;
+    std::cout << "Search Throughput(Ops/sec): " << throughput;
+    if(miss_ratio > 0)
+	std::cout << " (" << miss_ratio << "% misses)";
+    std::cout << "\033[0m" << std::endl;
 
     clear_cache();
     clock_gettime(CLOCK_MONOTONIC, &start);
@@ -234,6 +468,59 @@ inline void benchmark_t<Key_t>::microbench(int index_type, Pair<Key_t>* init_kv,
 }
 
     
+/* ClockCache on its own, used cache-aside: a Get that misses is followed by an Insert, which evicts once
+ * the cache is full. The stream is init_num zipfian (0.99) accesses over init_num keys; every capacity
+ * gets a warm-up pass over it before the measured one. */
+template <typename Key_t>
+inline void benchmark_t<Key_t>::cache(Pair<Key_t>* init_kv, int init_num, int num_threads){
+    zipfian_key_generator_t gen(init_num, sizeof(Key_t) > 8 ? sizeof(Key_t)-1 : sizeof(Key_t));
+    for(int i=0; i<init_num; i++){
+	auto key = gen.next();
+	if constexpr(sizeof(Key_t) > 8){
+	    memcpy(init_kv[i].key, key, sizeof(Key_t)-1);
+	    init_kv[i].key[sizeof(Key_t)-1] = 0;
+	}
+	else{
+	    memcpy(&init_kv[i].key, key, sizeof(Key_t));
+	    if(init_kv[i].key == 0)
+		init_kv[i].key = 1;
+	}
+	init_kv[i].value = i+1;
+    }
+
+    for(int percent: {1, 5, 10, 25}){
+	ClockCache<Key_t> cache(std::max((size_t)init_num * percent / 100, (size_t)1));
+	std::atomic<size_t> hits(0);
+	auto cache_func = [&cache, &init_kv, init_num, num_threads, &hits](uint64_t thread_id, bool){
+	    size_t chunk = init_num / num_threads;
+	    size_t from = chunk * thread_id;
+	    size_t to = chunk * (thread_id+1);
+	    size_t _hits = 0;
+	    default_value v;
+	    for(size_t i=from; i<to; i++){
+		if(cache.Get(init_kv[i].key, v))
+		    _hits++;
+		else
+		    cache.Insert(init_kv[i].key, init_kv[i].value);
+	    }
+	    hits += _hits;
+	};
+	start_threads(&cache, num_threads, cache_func, false);
+	hits = 0;
+	auto evictions = cache.Evictions();
+	clear_cache();
+	double start_time = get_now();
+	start_threads(&cache, num_threads, cache_func, false);
+	double end_time = get_now();
+
+	size_t accesses = init_num / num_threads * num_threads;
+	double throughput = accesses / (end_time - start_time) / 1000000; // MOps/sec
+	std::cout << "ClockCache(" << percent << "% of keys, " << cache.Capacity() << " pairs) hit ratio: " << (double)hits / accesses * 100 << " %, ";
+	std::cout << "\033[1;32m" << "Throughput(MOps/sec): " << throughput << "\033[0m";
+	std::cout << ", evictions: " << cache.Evictions() - evictions << std::endl;
+    }
+}
+
 template <typename Key_t>
 inline void benchmark_t<Key_t>::ycsb_load(int workload_type, int index_type, Pair<Key_t>* init_kv, int init_num, Pair<Key_t>* run_kv, int run_num, int* ops){
     std::string init_file;
@@ -255,6 +542,14 @@ inline void benchmark_t<Key_t>::ycsb_load(int workload_type, int index_type, Pai
 	init_file = "/hk/workloads2/loadd_zipfian_int_100M.dat";
 	txn_file = "/hk/workloads2/txnsd_zipfian_int_100M.dat";
     }
+    else if(workload_type == WORKLOAD_E){
+	init_file = "/hk/workloads2/loade_zipfian_int_100M.dat";
+	txn_file = "/hk/workloads2/txnse_zipfian_int_100M.dat";
+    }
+    else if(workload_type == WORKLOAD_F){
+	init_file = "/hk/workloads2/loadf_zipfian_int_100M.dat";
+	txn_file = "/hk/workloads2/txnsf_zipfian_int_100M.dat";
+    }
     else{
 	fprintf(stderr, "unkonw workload type %d\n", workload_type);
 	exit(1);
@@ -280,6 +575,9 @@ inline void benchmark_t<Key_t>::ycsb_load(int workload_type, int index_type, Pai
     std::string insert("INSERT");
     std::string read("READ");
     std::string update("UPDATE");
+    std::string rmw("READMODIFYWRITE");
+    std::string scan("SCAN");
+    size_t range;
 
     for(int i=0; i<init_num; i++){
 	if constexpr(sizeof(Key_t) > 8)
@@ -329,7 +627,7 @@ inline void benchmark_t<Key_t>::ycsb_load(int workload_type, int index_type, Pai
 	    }
 	    else
 		run_kv[i].key = key;
-	    run_kv[i].value = (uint64_t)&run_kv[i];
+	    run_kv[i].value = (int64_t)&run_kv[i];
 	}
 	else if(op.compare(read) == 0){
 	    ops[i] = OP_READ;
@@ -350,7 +648,25 @@ inline void benchmark_t<Key_t>::ycsb_load(int workload_type, int index_type, Pai
 	    }
 	    else
 		run_kv[i].key = key;
-	    run_kv[i].value = (uint64_t)&run_kv[i];
+	    run_kv[i].value = (int64_t)&run_kv[i];
+	}
+	else if(op.compare(rmw) == 0){
+	    ops[i] = OP_RMW;
+	    if constexpr(sizeof(Key_t) > 8)
+		strcpy(run_kv[i].key, key_.c_str());
+	    else
+		run_kv[i].key = key;
+	    run_kv[i].value = 1;
+	}
+	else if(op.compare(scan) == 0){
+	    /* SCAN key range: the value of a scan is the number of pairs it reads */
+	    ops[i] = OP_SCAN;
+	    infile_txn >> range;
+	    if constexpr(sizeof(Key_t) > 8)
+		strcpy(run_kv[i].key, key_.c_str());
+	    else
+		run_kv[i].key = key;
+	    run_kv[i].value = range;
 	}
 	else{
 	    fprintf(stderr, "unknown operation type\n");
@@ -365,6 +681,14 @@ inline void benchmark_t<Key_t>::ycsb_load(int workload_type, int index_type, Pai
 
 template <typename Key_t>
 inline void benchmark_t<Key_t>::ycsb_exec(int workload_type, int index_type, Pair<Key_t>* init_kv, int init_num, Pair<Key_t>* run_kv, int run_num, int num_threads, int* ops, bool pcm_enabled){
+    dispatch(index_type, [&](auto* hashtable){
+	ycsb_exec(hashtable, workload_type, init_kv, init_num, run_kv, run_num, num_threads, ops, pcm_enabled);
+    });
+}
+
+template <typename Key_t>
+template <typename Index>
+inline void benchmark_t<Key_t>::ycsb_exec(Index* hashtable, int workload_type, Pair<Key_t>* init_kv, int init_num, Pair<Key_t>* run_kv, int run_num, int num_threads, int* ops, bool pcm_enabled){
     /*
     if(memory_bandwidth){
 	if(geteuid() != 0){
@@ -382,16 +706,20 @@ inline void benchmark_t<Key_t>::ycsb_exec(int workload_type, int index_type, Pai
 	PCM_NUMA::InitNumaMonitor();
     }*/
 
-    Hash<Key_t>* hashtable = getInstance<Key_t>(index_type);
     //init_num = 100;
     //run_num = 100;
 
-    auto load_func = [&hashtable, &init_kv, init_num, num_threads](uint64_t thread_id, bool){
+    auto load_func = [&hashtable, &init_kv, init_num, num_threads, batch_size = batch_size](uint64_t thread_id, bool){
 	size_t total_num = init_num;
 	size_t chunk_size = total_num / num_threads;
 	size_t from = chunk_size * thread_id;
 	size_t to = chunk_size * (thread_id+1);
 
+	if(batch_size > 1){
+	    for(size_t i=from; i<to; i+=batch_size)
+		hashtable->InsertBatch(&init_kv[i], std::min(batch_size, to-i));
+	    return;
+	}
 	for(size_t i=from; i<to; i++){
 	    hashtable->Insert(init_kv[i].key, init_kv[i].value);
 	}
@@ -410,9 +738,17 @@ inline void benchmark_t<Key_t>::ycsb_exec(int workload_type, int index_type, Pai
 	before = std::make_unique<SystemCounterState>();
 	*before = getSystemCounterState();
     }
+    if(presize){
+	double reserve_start = get_now();
+	hashtable->Reserve(init_num);
+	std::cout << "Reserve(msec): " << (get_now() - reserve_start) * 1000 << std::endl;
+    }
     clear_cache();
     double start_time = get_now();
-    start_threads(hashtable, num_threads, load_func, false);
+    if(bulk_load)
+	hashtable->BulkLoad(init_kv, init_num, num_threads);
+    else
+	start_threads(hashtable, num_threads, load_func, false);
     double end_time = get_now();
 
     std::unique_ptr<SystemCounterState> after;
@@ -438,24 +774,63 @@ inline void benchmark_t<Key_t>::ycsb_exec(int workload_type, int index_type, Pai
 		  << "\tWrites(byes): " << getBytesWrittenToMC(*before, *after) << std::endl;
     }
 
-    auto exec_func = [&hashtable, &run_kv, run_num, &ops, num_threads](uint64_t thread_id, bool){
+    if(frozen_index){
+	if(workload_type == WORKLOAD_C){
+	    double freeze_start = get_now();
+	    frozen_index->Freeze(num_threads);
+	    std::cout << "Freeze(msec): " << (get_now() - freeze_start) * 1000 << ", frozen table: " << frozen_index->Bytes() << " bytes ("
+		      << (double)frozen_index->Bytes() / init_num << " bytes/key)" << std::endl;
+	}
+	else
+	    std::cout << "--freeze: the workload writes, running on the mutable index" << std::endl;
+    }
+
+    /* workload e scans, which only an ordered index can do */
+    OrderedIndex<Key_t>* ordered = nullptr;
+    if(workload_type == WORKLOAD_E){
+	if constexpr(std::is_base_of_v<OrderedIndex<Key_t>, Index>)
+	    ordered = hashtable;
+	else
+	    ordered = dynamic_cast<OrderedIndex<Key_t>*>((Hash<Key_t>*)hashtable);
+	if(!ordered){
+	    fprintf(stderr, "workload e needs an ordered index (btree) without wrappers\n");
+	    exit(1);
+	}
+    }
+
+    auto exec_func = [&hashtable, ordered, &run_kv, run_num, &ops, num_threads](uint64_t thread_id, bool){
 	size_t total_num = run_num;
 	size_t chunk_size = total_num / num_threads;
 	size_t from = chunk_size * thread_id;
 	size_t to = chunk_size * (thread_id+1);
+	std::vector<Pair<Key_t>> scanned;
 
 	for(size_t i=from; i<to; i++){
 	    if(ops[i] == OP_INSERT){
-		hashtable->Insert(run_kv[i].key, run_kv[i].value);
+		/* run-phase inserts may hit keys that are already loaded */
+		hashtable->Upsert(run_kv[i].key, run_kv[i].value);
 	    }
 	    else if(ops[i] == OP_READ){
-		auto ret = hashtable->Get(run_kv[i].key);
-		if((uint64_t)ret == 0)
+		default_value v;
+		if(!hashtable->Get(run_kv[i].key, v))
 		    std::cout << "not found" << std::endl;
 	    }
 	    else if(ops[i] == OP_UPDATE){
 		auto ret = hashtable->Update(run_kv[i].key, run_kv[i].value);
 	    }
+	    else if(ops[i] == OP_RMW){
+		/* the value of a read-modify-write is the delta, as for a counter */
+		hashtable->FetchAdd(run_kv[i].key, run_kv[i].value);
+	    }
+	    else if(ops[i] == OP_SCAN){
+		size_t range = (int64_t)run_kv[i].value;
+		if(scanned.size() < range)
+		    scanned.resize(range);
+		if constexpr(std::is_base_of_v<OrderedIndex<Key_t>, Index>)
+		    hashtable->Scan(run_kv[i].key, range, scanned.data());
+		else
+		    ordered->Scan(run_kv[i].key, range, scanned.data());
+	    }
 	}
 	return;
     };
@@ -497,6 +872,10 @@ inline void benchmark_t<Key_t>::ycsb_exec(int workload_type, int index_type, Pai
 	std::cout << "Read " << throughput << "\033[0m" << std::endl;
     else if(workload_type == WORKLOAD_D)
 	std::cout << "Read/Update " << throughput << "\033[0m" << std::endl;
+    else if(workload_type == WORKLOAD_E)
+	std::cout << "Scan/Insert " << throughput << "\033[0m" << std::endl;
+    else if(workload_type == WORKLOAD_F)
+	std::cout << "Read/ReadModifyWrite " << throughput << "\033[0m" << std::endl;
 
     if(pcm_enabled){
 	std::cout << "PCM Metrics:\n"
@@ -504,6 +883,8 @@ inline void benchmark_t<Key_t>::ycsb_exec(int workload_type, int index_type, Pai
 		  << "\tReads(bytes): " << getBytesReadFromMC(*before, *after) << "\n"
 		  << "\tWrites(byes): " << getBytesWrittenToMC(*before, *after) << std::endl;
     }
+    if(frozen_index && frozen_index->Frozen())
+	frozen_index->Thaw();
 }
 
 
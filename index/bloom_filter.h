@@ -0,0 +1,198 @@
+#ifndef BLOOM_FILTER_H_
+#define BLOOM_FILTER_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <functional>
+
+#include "util/pair.h"
+#include "util/key_traits.h"
+#include "util/counter.h"
+#include "index/interface.h"
+
+using namespace std;
+
+/* Blocked Bloom filter in front of an index, so that a lookup of a key that is not there usually
+ * returns before it probes a segment or walks a probe chain. A key hashes to one cache line of
+ * kWords 64-bit words and sets one bit in each of them (split block Bloom filter, Putze et al.),
+ * so a check is a single line fetch; at kBitsPerKey bits per key about 1% of misses get through.
+ * Bits are set with atomic or before the pair goes to the index, so a key the index returns is
+ * never filtered out. Deletes leave their bits behind (they only cost false positives) until
+ * Rebuild(); Reserve grows the filter along with the index. Writes must not bypass the filter. */
+template <typename Key_t, typename Value_t = default_value>
+class BloomFilter final : public Hash<Key_t, Value_t> {
+  using KT = KeyTraits<Key_t>;
+  public:
+    static const size_t kWords = 8;  // per block, one cache line
+    static const size_t kBitsPerKey = 10;
+    static const size_t kSeed = 0x5bd1e995UL;  // not the engines' seed, so blocks and slots are independent
+
+    BloomFilter(Hash<Key_t, Value_t>* _index, size_t expected): index(_index), blocks(nullptr){
+	allocate(expected);
+    }
+    ~BloomFilter(void){
+	free(blocks);
+    }
+
+    bool Get(Key_t& key, Value_t& value){
+	return contains(key) && index->Get(key, value);
+    }
+    task<bool> GetCoro(Key_t& key, Value_t& value){
+	if(!contains(key))
+	    return ready(false);
+	return index->GetCoro(key, value);
+    }
+    bool Update(Key_t& key, Value_t value){
+	return contains(key) && index->Update(key, value);
+    }
+    bool Delete(Key_t& key){
+	return contains(key) && index->Delete(key);
+    }
+    bool FetchAdd(Key_t& key, Value_t delta, Value_t* prev = nullptr){
+	return contains(key) && index->FetchAdd(key, delta, prev);
+    }
+    bool CompareExchange(Key_t& key, Value_t& expected, Value_t desired){
+	return contains(key) && index->CompareExchange(key, expected, desired);
+    }
+    bool Modify(Key_t& key, const function<Value_t(Value_t)>& fn){
+	return contains(key) && index->Modify(key, fn);
+    }
+
+    void Insert(Key_t& key, Value_t value){
+	add(key);
+	index->Insert(key, value);
+    }
+    bool Upsert(Key_t& key, Value_t value){
+	add(key);
+	return index->Upsert(key, value);
+    }
+    bool GetOrInsert(Key_t& key, Value_t& value){
+	add(key);
+	return index->GetOrInsert(key, value);
+    }
+    void InsertBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	for(size_t i=0; i<num; i++)
+	    add(kv[i].key);
+	index->InsertBatch(kv, num);
+    }
+    size_t UpdateBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	return index->UpdateBatch(kv, num);
+    }
+    size_t DeleteBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	return index->DeleteBatch(kv, num);
+    }
+
+    /* Reserve, BulkLoad and Rebuild must not run concurrently with any other operation */
+    void Reserve(size_t num){
+	index->Reserve(num);
+	if(planned(index->Size() + num) > nblocks){
+	    allocate(index->Size() + num);
+	    fill();
+	}
+    }
+    void BulkLoad(Pair<Key_t, Value_t>* kv, size_t num, size_t num_threads = 1){
+	if(planned(index->Size() + num) > nblocks){
+	    allocate(index->Size() + num);
+	    fill();
+	}
+	for(size_t i=0; i<num; i++)
+	    add(kv[i].key);
+	index->BulkLoad(kv, num, num_threads);
+    }
+    /* drops the bits of deleted keys */
+    void Rebuild(size_t num_threads = 1){
+	allocate(index->Size());
+	fill(num_threads);
+    }
+
+    void ForEach(const function<void(const Pair<Key_t, Value_t>*, size_t)>& fn, size_t num_threads = 1){
+	index->ForEach(fn, num_threads);
+    }
+    size_t Size(void){ return index->Size(); }
+    double Utilization(void){ return index->Utilization(); }
+    size_t Capacity(void){ return index->Capacity(); }
+    void FindAnyway(Key_t& key){ index->FindAnyway(key); }
+
+    /* operations answered by the filter alone */
+    size_t Filtered(void){ return filtered.sum(); }
+
+  private:
+    struct alignas(64) block_t{
+	uint64_t word[kWords];
+    };
+
+    /* one bit per word, picked by the high half of the hash under a different odd salt per word;
+     * the low half picks the block */
+    static uint64_t bit(size_t key_hash, size_t w){
+	static const uint32_t salt[kWords] = {0x47b6137bU, 0x44974d91U, 0x8824ad5bU, 0xa2b7289dU,
+					      0x705495c7U, 0x2df1424bU, 0x9efc4947U, 0x5c6bfb31U};
+	return (uint64_t)1 << (((uint32_t)(key_hash >> 32) * salt[w]) >> 26);
+    }
+
+    block_t& block(size_t key_hash){
+	return blocks[key_hash & (nblocks - 1)];
+    }
+
+    void add(const Key_t& key){
+	auto key_hash = KT::hash(key, kSeed);
+	auto& b = block(key_hash);
+	for(size_t w=0; w<kWords; w++){
+	    auto m = bit(key_hash, w);
+	    if(!(__atomic_load_n(&b.word[w], __ATOMIC_RELAXED) & m))
+		__atomic_fetch_or(&b.word[w], m, __ATOMIC_RELEASE);
+	}
+    }
+
+    bool contains(const Key_t& key){
+	auto key_hash = KT::hash(key, kSeed);
+	auto& b = block(key_hash);
+	uint64_t miss = 0;
+	for(size_t w=0; w<kWords; w++)
+	    miss |= bit(key_hash, w) & ~__atomic_load_n(&b.word[w], __ATOMIC_ACQUIRE);
+	if(miss){
+	    filtered.add(1);
+	    return false;
+	}
+	return true;
+    }
+
+    /* power of two number of blocks for num keys at kBitsPerKey */
+    static size_t planned(size_t num){
+	size_t n = 1;
+	while(n * kWords * 64 < num * kBitsPerKey)
+	    n <<= 1;
+	return n;
+    }
+
+    void allocate(size_t num){
+	free(blocks);
+	nblocks = planned(num);
+	blocks = (block_t*)aligned_alloc(sizeof(block_t), nblocks * sizeof(block_t));
+	if(!blocks){
+	    fprintf(stderr, "%s: failed to allocate %zu filter blocks\n", __func__, nblocks);
+	    exit(1);
+	}
+	memset((void*)blocks, 0, nblocks * sizeof(block_t));
+    }
+
+    void fill(size_t num_threads = 1){
+	index->ForEach([this](const Pair<Key_t, Value_t>* kv, size_t num){
+		for(size_t i=0; i<num; i++)
+		    add(kv[i].key);
+	    }, num_threads);
+    }
+
+    static task<bool> ready(bool found){
+	co_return found;
+    }
+
+    Hash<Key_t, Value_t>* index;
+    block_t* blocks;
+    size_t nblocks;
+    sharded_counter filtered;
+};
+
+#endif  // BLOOM_FILTER_H_
@@ -0,0 +1,642 @@
+#ifndef BTREE_OLC_H_
+#define BTREE_OLC_H_
+
+#include <iostream>
+#include <cstdint>
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
+#include <stddef.h>
+#include <vector>
+#include <algorithm>
+#include <functional>
+
+#include "util/pair.h"
+#include "util/key_traits.h"
+#include "util/parallel.h"
+#include "util/counter.h"
+#include "util/wait.h"
+#include "util/coroutine.h"
+#include "index/interface.h"
+
+using namespace std;
+
+/* B+-tree with optimistic lock coupling (Leis et al., "The ART of Practical Synchronization", DaMoN '16).
+ * Every node has a version that is odd while a writer holds it. Readers never write to shared memory:
+ * they descend reading the version of a child before validating its parent's, and retry from the root
+ * when a version changed under them. Writers descend the same way and lock the leaf they change by
+ * bumping its version; a full node is split on the way down, under its own lock and its parent's, so a
+ * split never goes up more than one level. Atomic value operations take the leaf exclusively.
+ * Leaves are linked left to right for Scan and ForEach. Deletes do not merge nodes, so no node is freed
+ * before the tree is, which is what makes reading a node that a writer changes meanwhile safe. */
+template <typename Key_t, typename Value_t = default_value>
+class BTreeOLC final : public OrderedIndex<Key_t, Value_t> {
+  static const size_t kPageSize = 1024;
+  using KT = KeyTraits<Key_t>;
+  using VT = ValueTraits<Value_t>;
+
+  struct node_t{
+    uint64_t version;  // odd while write locked
+    uint16_t count;
+    bool leaf;
+  };
+  struct leaf_t: node_t{
+    static const size_t kSlots = (kPageSize - sizeof(node_t) - sizeof(void*)) / (sizeof(Key_t) + sizeof(Value_t));
+    leaf_t* next;
+    Key_t keys[kSlots];
+    Value_t values[kSlots];
+  };
+  /* child i holds the keys in (keys[i-1], keys[i]] */
+  struct inner_t: node_t{
+    static const size_t kSlots = (kPageSize - sizeof(node_t) - sizeof(void*)) / (sizeof(Key_t) + sizeof(void*));
+    Key_t keys[kSlots];
+    node_t* children[kSlots+1];
+  };
+  const size_t kBulkLeaf = leaf_t::kSlots - leaf_t::kSlots/4;  // pairs per leaf BulkLoad leaves room for
+  const size_t kBulkInner = inner_t::kSlots - inner_t::kSlots/4 + 1;  // children per inner node
+
+  public:
+    BTreeOLC(void): root{new_leaf()}, nleaves{1} { }
+    ~BTreeOLC(void){
+	release(root);
+    }
+
+    void Insert(Key_t& key, Value_t value){
+	upsert(key, value, true);
+    }
+    bool Upsert(Key_t& key, Value_t value){
+	return upsert(key, value, true);
+    }
+    bool GetOrInsert(Key_t& key, Value_t& value){
+	return upsert(key, value, false);
+    }
+    bool Update(Key_t& key, Value_t value){
+	return apply(key, [&](Value_t* v){
+		*v = value;
+		return true;
+	    });
+    }
+    bool FetchAdd(Key_t& key, Value_t delta, Value_t* prev = nullptr){
+	return apply(key, [&](Value_t* v){
+		auto old = VT::fetch_add(*v, delta);
+		if(prev) *prev = old;
+		return true;
+	    });
+    }
+    bool CompareExchange(Key_t& key, Value_t& expected, Value_t desired){
+	return apply(key, [&](Value_t* v){
+		return VT::compare_exchange(*v, expected, desired);
+	    });
+    }
+    bool Modify(Key_t& key, const function<Value_t(Value_t)>& fn){
+	return apply(key, [&](Value_t* v){
+		*v = fn(*v);
+		return true;
+	    });
+    }
+    bool Delete(Key_t&);
+    bool Get(Key_t&, Value_t&);
+    task<bool> GetCoro(Key_t&, Value_t&);
+    size_t Scan(Key_t&, size_t, Pair<Key_t, Value_t>*);
+    void ForEach(const function<void(const Pair<Key_t, Value_t>*, size_t)>& fn, size_t num_threads = 1);
+    /* the tree grows a leaf at a time, there is nothing to set aside */
+    void Reserve(size_t){ }
+    void BulkLoad(Pair<Key_t, Value_t>*, size_t, size_t num_threads = 1);
+    void FindAnyway(Key_t&);
+
+    size_t Size(void){
+	return items.sum();
+    }
+    double Utilization(void){
+	return ((double)Size()) / ((double)Capacity())*100;
+    }
+    size_t Capacity(void){
+	return __atomic_load_n(&nleaves, __ATOMIC_RELAXED) * leaf_t::kSlots;
+    }
+
+  private:
+    static leaf_t* new_leaf(void){
+	auto leaf = (leaf_t*)alloc();
+	leaf->leaf = true;
+	return leaf;
+    }
+    static inner_t* new_inner(void){
+	return (inner_t*)alloc();
+    }
+    static void* alloc(void){
+	static_assert(sizeof(leaf_t) <= kPageSize && sizeof(inner_t) <= kPageSize);
+	void* node = aligned_alloc(64, kPageSize);
+	if(!node){
+	    fprintf(stderr, "%s: failed to allocate a node\n", __func__);
+	    exit(1);
+	}
+	memset(node, 0, kPageSize);
+	return node;
+    }
+    void release(node_t* node){
+	if(!node->leaf){
+	    auto inner = (inner_t*)node;
+	    for(size_t i=0; i<=inner->count; i++)
+		release(inner->children[i]);
+	}
+	free(node);
+    }
+
+    /* version of node, false if a writer holds it */
+    static bool read_lock(node_t* node, uint64_t& version){
+	version = __atomic_load_n(&node->version, __ATOMIC_ACQUIRE);
+	return !(version & 1);
+    }
+    /* whether node is still at version, i.e., what was read from it since is consistent */
+    static bool validate(node_t* node, uint64_t version){
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	return __atomic_load_n(&node->version, __ATOMIC_RELAXED) == version;
+    }
+    static bool upgrade(node_t* node, uint64_t version){
+	return __atomic_compare_exchange_n(&node->version, &version, version+1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+    static void unlock(node_t* node){
+	__atomic_fetch_add(&node->version, 1, __ATOMIC_RELEASE);
+    }
+
+    /* a count read without the lock may be torn, so it is kept in bounds until validated */
+    static size_t count(node_t* node, size_t max){
+	return std::min((size_t)__atomic_load_n(&node->count, __ATOMIC_RELAXED), max);
+    }
+    template <typename Node>
+    static size_t lower_bound(Node* node, size_t cnt, const Key_t& key){
+	size_t lo = 0, hi = cnt;
+	while(lo < hi){
+	    auto mid = (lo + hi) / 2;
+	    if(KT::compare(node->keys[mid], key) < 0)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	return lo;
+    }
+    template <typename Node>
+    static size_t upper_bound(Node* node, size_t cnt, const Key_t& key){
+	size_t lo = 0, hi = cnt;
+	while(lo < hi){
+	    auto mid = (lo + hi) / 2;
+	    if(KT::compare(node->keys[mid], key) <= 0)
+		lo = mid + 1;
+	    else
+		hi = mid;
+	}
+	return lo;
+    }
+    static node_t* child(inner_t* inner, const Key_t* key){
+	auto pos = key ? lower_bound(inner, count(inner, inner_t::kSlots), *key) : 0;
+	return __atomic_load_n(&inner->children[pos], __ATOMIC_RELAXED);
+    }
+
+    leaf_t* find_leaf(const Key_t*, uint64_t&);
+    leaf_t* lock_leaf(Key_t&);
+    bool upsert(Key_t&, Value_t&, bool);
+    template <typename F>
+    bool apply(Key_t&, F&&);
+    bool split(inner_t*, uint64_t, node_t*, uint64_t);
+    template <typename F>
+    void scan_range(const Key_t*, bool, const Key_t*, F&&);
+
+    node_t* root;
+    size_t nleaves;
+    sharded_counter items;
+};
+
+/* Optimistic descent to the leaf that holds key (the leftmost leaf for nullptr), returned with the
+ * version it had when its parent was validated. Only a split of the leaf itself changes the range of
+ * keys it holds, so a leaf still at that version is the right one. */
+template <typename Key_t, typename Value_t>
+typename BTreeOLC<Key_t, Value_t>::leaf_t* BTreeOLC<Key_t, Value_t>::find_leaf(const Key_t* key, uint64_t& version){
+    backoff b;
+RETRY:
+    auto node = __atomic_load_n(&root, __ATOMIC_ACQUIRE);
+    uint64_t v;
+    if(!read_lock(node, v) || node != __atomic_load_n(&root, __ATOMIC_ACQUIRE)){
+	b.pause();
+	goto RETRY;
+    }
+    while(!node->leaf){
+	auto next = child((inner_t*)node, key);
+	uint64_t next_v;
+	if(!next || !read_lock(next, next_v) || !validate(node, v)){
+	    b.pause();
+	    goto RETRY;
+	}
+	node = next;
+	v = next_v;
+    }
+    version = v;
+    return (leaf_t*)node;
+}
+
+template <typename Key_t, typename Value_t>
+typename BTreeOLC<Key_t, Value_t>::leaf_t* BTreeOLC<Key_t, Value_t>::lock_leaf(Key_t& key){
+    backoff b;
+    while(true){
+	uint64_t v;
+	auto leaf = find_leaf(&key, v);
+	if(upgrade(leaf, v))
+	    return leaf;
+	b.pause();
+    }
+}
+
+template <typename Key_t, typename Value_t>
+bool BTreeOLC<Key_t, Value_t>::Get(Key_t& key, Value_t& value){
+    backoff b;
+    while(true){
+	uint64_t v;
+	auto leaf = find_leaf(&key, v);
+	auto cnt = count(leaf, leaf_t::kSlots);
+	auto pos = lower_bound(leaf, cnt, key);
+	bool found = pos < cnt && KT::equal(leaf->keys[pos], key);
+	if(found)
+	    value = leaf->values[pos];
+	if(validate(leaf, v))
+	    return found;
+	b.pause();
+    }
+}
+
+/* the same descent, suspending before every node */
+template <typename Key_t, typename Value_t>
+task<bool> BTreeOLC<Key_t, Value_t>::GetCoro(Key_t& key, Value_t& value){
+    backoff b;
+    while(true){
+	auto node = __atomic_load_n(&root, __ATOMIC_ACQUIRE);
+	co_await prefetch(node, kPageSize);
+	uint64_t v;
+	bool valid = read_lock(node, v) && node == __atomic_load_n(&root, __ATOMIC_ACQUIRE);
+	while(valid && !node->leaf){
+	    auto next = child((inner_t*)node, &key);
+	    if(!next){
+		valid = false;
+		break;
+	    }
+	    co_await prefetch(next, kPageSize);
+	    uint64_t next_v;
+	    valid = read_lock(next, next_v) && validate(node, v);
+	    node = next;
+	    v = next_v;
+	}
+	if(valid){
+	    auto leaf = (leaf_t*)node;
+	    auto cnt = count(leaf, leaf_t::kSlots);
+	    auto pos = lower_bound(leaf, cnt, key);
+	    bool found = pos < cnt && KT::equal(leaf->keys[pos], key);
+	    if(found)
+		value = leaf->values[pos];
+	    if(validate(leaf, v))
+		co_return found;
+	}
+	b.pause();
+    }
+}
+
+/* inserts (key, value) and returns true, or returns false and replaces the value key has if assign,
+ * copies it to value if not */
+template <typename Key_t, typename Value_t>
+bool BTreeOLC<Key_t, Value_t>::upsert(Key_t& key, Value_t& value, bool assign){
+    backoff b;
+RETRY:
+    auto node = __atomic_load_n(&root, __ATOMIC_ACQUIRE);
+    uint64_t v;
+    if(!read_lock(node, v) || node != __atomic_load_n(&root, __ATOMIC_ACQUIRE)){
+	b.pause();
+	goto RETRY;
+    }
+    inner_t* parent = nullptr;
+    uint64_t parent_v = 0;
+    while(!node->leaf){
+	auto inner = (inner_t*)node;
+	if(count(inner, inner_t::kSlots) == inner_t::kSlots){
+	    if(!split(parent, parent_v, inner, v))
+		b.pause();
+	    goto RETRY;
+	}
+	auto next = child(inner, &key);
+	uint64_t next_v;
+	if(!next || !read_lock(next, next_v) || !validate(inner, v)){
+	    b.pause();
+	    goto RETRY;
+	}
+	parent = inner;
+	parent_v = v;
+	node = next;
+	v = next_v;
+    }
+
+    auto leaf = (leaf_t*)node;
+    auto cnt = count(leaf, leaf_t::kSlots);
+    auto pos = lower_bound(leaf, cnt, key);
+    bool found = pos < cnt && KT::equal(leaf->keys[pos], key);
+    if(!found && cnt == leaf_t::kSlots){
+	if(!split(parent, parent_v, leaf, v))
+	    b.pause();
+	goto RETRY;
+    }
+    /* a leaf still at v is as it was read above */
+    if(!upgrade(leaf, v)){
+	b.pause();
+	goto RETRY;
+    }
+    if(found){
+	if(assign)
+	    leaf->values[pos] = value;
+	else
+	    value = leaf->values[pos];
+	unlock(leaf);
+	return false;
+    }
+    memmove(&leaf->keys[pos+1], &leaf->keys[pos], (cnt - pos) * sizeof(Key_t));
+    memmove(&leaf->values[pos+1], &leaf->values[pos], (cnt - pos) * sizeof(Value_t));
+    KT::copy(leaf->keys[pos], key);
+    leaf->values[pos] = value;
+    leaf->count = cnt + 1;
+    unlock(leaf);
+    items.add(1);
+    return true;
+}
+
+/* Splits the full node under parent, or under a new root if it is the root; false if either of them
+ * changed since it was read. The parent has room: a full inner node is split before the descent goes on. */
+template <typename Key_t, typename Value_t>
+bool BTreeOLC<Key_t, Value_t>::split(inner_t* parent, uint64_t parent_v, node_t* node, uint64_t v){
+    if(parent && !upgrade(parent, parent_v))
+	return false;
+    if(!upgrade(node, v)){
+	if(parent) unlock(parent);
+	return false;
+    }
+    if(!parent && node != root){
+	unlock(node);
+	return false;
+    }
+
+    Key_t sep;
+    node_t* right;
+    if(node->leaf){
+	auto left = (leaf_t*)node;
+	auto r = new_leaf();
+	size_t half = left->count / 2;
+	r->count = left->count - half;
+	memcpy(r->keys, &left->keys[half], r->count * sizeof(Key_t));
+	memcpy(r->values, &left->values[half], r->count * sizeof(Value_t));
+	r->next = left->next;
+	KT::copy(sep, left->keys[half-1]);
+	left->count = half;
+	__atomic_store_n(&left->next, r, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&nleaves, 1, __ATOMIC_RELAXED);
+	right = r;
+    }
+    else{
+	auto left = (inner_t*)node;
+	auto r = new_inner();
+	size_t half = left->count / 2;
+	r->count = left->count - half - 1;
+	memcpy(r->keys, &left->keys[half+1], r->count * sizeof(Key_t));
+	memcpy(r->children, &left->children[half+1], (r->count + 1) * sizeof(node_t*));
+	KT::copy(sep, left->keys[half]);
+	left->count = half;
+	right = r;
+    }
+
+    if(parent){
+	/* children are moved a word at a time, so a reader never sees a torn pointer */
+	size_t cnt = parent->count;
+	auto pos = lower_bound(parent, cnt, sep);
+	memmove(&parent->keys[pos+1], &parent->keys[pos], (cnt - pos) * sizeof(Key_t));
+	for(size_t i=cnt+1; i>pos+1; i--)
+	    __atomic_store_n(&parent->children[i], parent->children[i-1], __ATOMIC_RELAXED);
+	KT::copy(parent->keys[pos], sep);
+	__atomic_store_n(&parent->children[pos+1], right, __ATOMIC_RELAXED);
+	parent->count = cnt + 1;
+    }
+    else{
+	auto r = new_inner();
+	KT::copy(r->keys[0], sep);
+	r->children[0] = node;
+	r->children[1] = right;
+	r->count = 1;
+	__atomic_store_n(&root, (node_t*)r, __ATOMIC_RELEASE);
+    }
+    unlock(node);
+    if(parent) unlock(parent);
+    return true;
+}
+
+template <typename Key_t, typename Value_t>
+template <typename F>
+bool BTreeOLC<Key_t, Value_t>::apply(Key_t& key, F&& fn){
+    auto leaf = lock_leaf(key);
+    auto cnt = leaf->count;
+    auto pos = lower_bound(leaf, cnt, key);
+    bool ret = pos < cnt && KT::equal(leaf->keys[pos], key) && fn(&leaf->values[pos]);
+    unlock(leaf);
+    return ret;
+}
+
+template <typename Key_t, typename Value_t>
+bool BTreeOLC<Key_t, Value_t>::Delete(Key_t& key){
+    auto leaf = lock_leaf(key);
+    size_t cnt = leaf->count;
+    auto pos = lower_bound(leaf, cnt, key);
+    if(pos == cnt || !KT::equal(leaf->keys[pos], key)){
+	unlock(leaf);
+	return false;
+    }
+    memmove(&leaf->keys[pos], &leaf->keys[pos+1], (cnt - pos - 1) * sizeof(Key_t));
+    memmove(&leaf->values[pos], &leaf->values[pos+1], (cnt - pos - 1) * sizeof(Value_t));
+    leaf->count = cnt - 1;
+    unlock(leaf);
+    items.add(-1);
+    return true;
+}
+
+/* Passes the pairs with keys from *from (after it if exclusive, from the first key for nullptr) up to
+ * *to (to the last key for nullptr) to fn(kv, num) a validated leaf at a time, until fn returns false.
+ * A leaf that changes while it is read, or before the scan has stepped from it to its successor, is
+ * looked up again from the root, after the last key passed on. */
+template <typename Key_t, typename Value_t>
+template <typename F>
+void BTreeOLC<Key_t, Value_t>::scan_range(const Key_t* from, bool exclusive, const Key_t* to, F&& fn){
+    Pair<Key_t, Value_t> buf[leaf_t::kSlots];
+    Key_t last;
+    auto lo = from;
+    bool after = exclusive;
+    backoff b;
+RETRY:
+    uint64_t v;
+    auto leaf = find_leaf(lo, v);
+    while(true){
+	auto cnt = count(leaf, leaf_t::kSlots);
+	size_t pos = !lo ? 0 : after ? upper_bound(leaf, cnt, *lo) : lower_bound(leaf, cnt, *lo);
+	size_t n = 0;
+	bool end = false;
+	for(; pos<cnt; pos++){
+	    if(to && KT::compare(leaf->keys[pos], *to) > 0){
+		end = true;
+		break;
+	    }
+	    KT::copy(buf[n].key, leaf->keys[pos]);
+	    buf[n].value = leaf->values[pos];
+	    n++;
+	}
+	auto next = __atomic_load_n(&leaf->next, __ATOMIC_RELAXED);
+	if(!validate(leaf, v)){
+	    b.pause();
+	    goto RETRY;
+	}
+	if(n){
+	    if(!fn((const Pair<Key_t, Value_t>*)buf, n))
+		return;
+	    KT::copy(last, buf[n-1].key);
+	    lo = &last;
+	    after = true;
+	}
+	if(end || !next)
+	    return;
+	uint64_t next_v;
+	if(!read_lock(next, next_v) || !validate(leaf, v)){
+	    b.pause();
+	    goto RETRY;
+	}
+	leaf = next;
+	v = next_v;
+    }
+}
+
+template <typename Key_t, typename Value_t>
+size_t BTreeOLC<Key_t, Value_t>::Scan(Key_t& start, size_t num, Pair<Key_t, Value_t>* out){
+    size_t n = 0;
+    if(num == 0)
+	return 0;
+    scan_range(&start, false, nullptr, [&](const Pair<Key_t, Value_t>* kv, size_t cnt){
+	    auto m = std::min(cnt, num - n);
+	    std::copy(kv, kv + m, out + n);
+	    n += m;
+	    return n < num;
+	});
+    return n;
+}
+
+/* the key ranges of the root's children go to the threads */
+template <typename Key_t, typename Value_t>
+void BTreeOLC<Key_t, Value_t>::ForEach(const function<void(const Pair<Key_t, Value_t>*, size_t)>& fn, size_t num_threads){
+    std::vector<Pair<Key_t, Value_t>> bounds;
+    backoff b;
+    while(true){
+	bounds.clear();
+	auto node = __atomic_load_n(&root, __ATOMIC_ACQUIRE);
+	uint64_t v;
+	if(read_lock(node, v) && node == __atomic_load_n(&root, __ATOMIC_ACQUIRE)){
+	    if(!node->leaf){
+		auto inner = (inner_t*)node;
+		auto cnt = count(inner, inner_t::kSlots);
+		bounds.resize(cnt);
+		for(size_t i=0; i<cnt; i++)
+		    KT::copy(bounds[i].key, inner->keys[i]);
+	    }
+	    if(validate(node, v))
+		break;
+	}
+	b.pause();
+    }
+
+    size_t nranges = bounds.size() + 1;
+    size_t next = 0;
+    parallel_run(std::max(std::min(num_threads, nranges), (size_t)1), [&](size_t){
+	    size_t r;
+	    while((r = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)) < nranges){
+		scan_range(r ? &bounds[r-1].key : nullptr, r > 0, r+1 < nranges ? &bounds[r].key : nullptr,
+			[&fn](const Pair<Key_t, Value_t>* kv, size_t num){
+			    fn(kv, num);
+			    return true;
+			});
+	    }
+	});
+}
+
+/* Sorts the pairs on num_threads threads and, into an empty tree, builds it bottom up with nodes
+ * kBulkLeaf/kBulkInner full, so that the first inserts do not split right away; pairs for a tree that
+ * is not empty are inserted in key order. */
+template <typename Key_t, typename Value_t>
+void BTreeOLC<Key_t, Value_t>::BulkLoad(Pair<Key_t, Value_t>* kv, size_t num, size_t num_threads){
+    if(num == 0)
+	return;
+    num_threads = std::max(std::min(num_threads, num), (size_t)1);
+    std::vector<Pair<Key_t, Value_t>> sorted(kv, kv + num);
+    auto less = [](const Pair<Key_t, Value_t>& a, const Pair<Key_t, Value_t>& b){ return KT::compare(a.key, b.key) < 0; };
+    parallel_run(num_threads, [&](size_t tid){
+	    std::sort(sorted.begin() + num*tid/num_threads, sorted.begin() + num*(tid+1)/num_threads, less);
+	});
+    for(size_t t=1; t<num_threads; t++)
+	std::inplace_merge(sorted.begin(), sorted.begin() + num*t/num_threads, sorted.begin() + num*(t+1)/num_threads, less);
+
+    if(!root->leaf || root->count){
+	for(auto& p: sorted)
+	    Insert(p.key, p.value);
+	return;
+    }
+
+    /* every node of the level below with its largest key, which separates it from the next one */
+    std::vector<node_t*> level;
+    std::vector<Pair<Key_t, Value_t>> largest;
+    leaf_t* prev = nullptr;
+    for(size_t i=0; i<num; i+=kBulkLeaf){
+	auto leaf = new_leaf();
+	leaf->count = std::min(kBulkLeaf, num - i);
+	for(size_t j=0; j<leaf->count; j++){
+	    KT::copy(leaf->keys[j], sorted[i+j].key);
+	    leaf->values[j] = sorted[i+j].value;
+	}
+	if(prev)
+	    prev->next = leaf;
+	prev = leaf;
+	level.push_back(leaf);
+	largest.push_back(sorted[i + leaf->count - 1]);
+    }
+    auto nlevel = level.size();
+    while(level.size() > 1){
+	std::vector<node_t*> up;
+	std::vector<Pair<Key_t, Value_t>> up_largest;
+	for(size_t i=0; i<level.size(); i+=kBulkInner){
+	    auto inner = new_inner();
+	    size_t n = std::min(kBulkInner, level.size() - i);
+	    for(size_t j=0; j<n; j++){
+		inner->children[j] = level[i+j];
+		if(j+1 < n)
+		    KT::copy(inner->keys[j], largest[i+j].key);
+	    }
+	    inner->count = n - 1;
+	    up.push_back(inner);
+	    up_largest.push_back(largest[i+n-1]);
+	}
+	level.swap(up);
+	largest.swap(up_largest);
+    }
+    free(root);
+    root = level[0];
+    nleaves = nlevel;
+    items.add(num);
+}
+
+template <typename Key_t, typename Value_t>
+void BTreeOLC<Key_t, Value_t>::FindAnyway(Key_t& key){
+    auto node = root;
+    while(!node->leaf)
+	node = ((inner_t*)node)->children[0];
+    for(auto leaf=(leaf_t*)node; leaf; leaf=leaf->next){
+	for(size_t i=0; i<leaf->count; i++){
+	    if(KT::equal(leaf->keys[i], key))
+		return;
+	}
+    }
+    cout << "NOT FOUND for key " << key << endl;
+}
+
+#endif  // BTREE_OLC_H_
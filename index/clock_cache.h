@@ -0,0 +1,334 @@
+#pragma once
+#include <stddef.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <algorithm>
+#include "util/pair.h"
+#include "util/hash.h"
+#include "util/key_traits.h"
+#include "util/parallel.h"
+#include "util/counter.h"
+#include "util/rwlock.h"
+#include "util/wait.h"
+#include "index/interface.h"
+
+using namespace std;
+
+/* Capacity-bounded cache on a bucketized two-choice table: a key lives in one of kWays slots of one of two
+ * buckets, as in cuckoo hashing without displacements, and the table never resizes. A put into two full
+ * buckets evicts with CLOCK over their 2*kWays slots: every slot has a reference bit that a hit sets, and
+ * the hands of the two buckets take turns sweeping, clearing set bits, until they reach a slot whose bit
+ * is clear. A hit writes its bit only when it is clear, so hot keys cost readers no stores, and there is
+ * no recency list to update under a lock. Get takes no lock and validates against the versioned stripe
+ * locks as CuckooHash does; writers lock the stripes of both buckets in ascending order.
+ * A bucket holds the keys and the clock state of its slots in one cache line, e.g., 7 ways of 8-byte keys,
+ * and its values sit in a separate array that only a hit touches: a miss reads two lines, a hit three.
+ * Keys wider than 14 bytes get 4 ways and a bucket of several lines. */
+template <typename Key_t, typename Value_t = default_value, typename Hasher = default_hash, typename Lock = default_lock>
+class ClockCache final : public Hash<Key_t, Value_t> {
+  const size_t kSeed[2] = {0xc70f6907UL, 0x9ae16a3b2f90404fUL};
+  static const size_t kWays = std::min(std::max((64 - 2*sizeof(uint32_t)) / sizeof(Key_t), (size_t)4), (size_t)32);
+  using KT = KeyTraits<Key_t, Hasher>;
+  using VT = ValueTraits<Value_t>;
+  using stripe_t = versioned_lock<Lock>;
+
+  struct alignas(64) bucket_t {
+    Key_t keys[kWays];
+    uint32_t ref;  // reference bit per slot
+    uint32_t hand;  // next slot the clock looks at, under the stripe lock
+  };
+  static_assert(sizeof(Key_t) > 14 || sizeof(bucket_t) == 64, "the keys of a bucket fit in one cache line");
+
+  public:
+    /* holds at most capacity pairs */
+    ClockCache(size_t capacity) {
+      nbuckets = std::max((capacity + kWays - 1) / kWays, (size_t)1);
+      buckets = (bucket_t*)aligned_alloc(64, nbuckets * sizeof(bucket_t));
+      if (!buckets) {
+        fprintf(stderr, "%s: failed to allocate %zu buckets\n", __func__, nbuckets);
+        exit(1);
+      }
+      memset((void*)buckets, 0, nbuckets * sizeof(bucket_t));
+      values = (Value_t*)aligned_alloc(64, (nbuckets * kWays * sizeof(Value_t) + 63) / 64 * 64);
+      if (!values) {
+        fprintf(stderr, "%s: failed to allocate %zu buckets\n", __func__, nbuckets);
+        exit(1);
+      }
+      locksize = 16;
+      nlocks = nbuckets / locksize + 1;
+      mutex = new stripe_t[nlocks];
+    }
+
+    ~ClockCache(void) {
+      free(buckets);
+      free(values);
+      delete[] mutex;
+    }
+
+    void Insert(Key_t& key, Value_t value) {
+      put(key, value, true);
+    }
+    bool Upsert(Key_t& key, Value_t value) {
+      return put(key, value, true);
+    }
+    bool GetOrInsert(Key_t& key, Value_t& value) {
+      return put(key, value, false);
+    }
+    bool Update(Key_t& key, Value_t value) {
+      return apply(key, [&](Value_t* v){
+        VT::store(*v, value);
+        return true;
+      });
+    }
+    bool FetchAdd(Key_t& key, Value_t delta, Value_t* prev = nullptr) {
+      return apply(key, [&](Value_t* v){
+        auto old = VT::fetch_add(*v, delta);
+        if (prev) *prev = old;
+        return true;
+      });
+    }
+    bool CompareExchange(Key_t& key, Value_t& expected, Value_t desired) {
+      return apply(key, [&](Value_t* v){
+        return VT::compare_exchange(*v, expected, desired);
+      });
+    }
+    bool Modify(Key_t& key, const function<Value_t(Value_t)>& fn) {
+      return apply(key, [&](Value_t* v){
+        auto old = VT::load(*v);
+        while (!VT::compare_exchange(*v, old, fn(old)));
+        return true;
+      });
+    }
+    bool Delete(Key_t&);
+    bool Get(Key_t&, Value_t&);
+    task<bool> GetCoro(Key_t&, Value_t&);
+    void ForEach(const function<void(const Pair<Key_t, Value_t>*, size_t)>&, size_t num_threads = 1);
+    /* the capacity is fixed: nothing to reserve, and a bulk load beyond it evicts like any put */
+    void Reserve(size_t) { }
+    void BulkLoad(Pair<Key_t, Value_t>* kv, size_t num, size_t = 1) {
+      for (size_t i = 0; i < num; i++) put(kv[i].key, kv[i].value, true);
+    }
+
+    size_t Size(void) { return pairs.sum(); }
+    double Utilization(void) { return ((double)Size())/((double)Capacity())*100; }
+    size_t Capacity(void) { return nbuckets * kWays; }
+    void FindAnyway(Key_t&) { }
+    size_t Evictions(void) { return evictions.sum(); }
+
+  private:
+    void locate(Key_t& key, size_t idx[2]) {
+      idx[0] = KT::hash(key, kSeed[0]) % nbuckets;
+      idx[1] = KT::hash(key, kSeed[1]) % nbuckets;
+    }
+    /* stripes of both buckets, ascending and without duplicates */
+    size_t stripes(size_t idx[2], size_t loc[2]) {
+      loc[0] = std::min(idx[0], idx[1]) / locksize;
+      loc[1] = std::max(idx[0], idx[1]) / locksize;
+      return loc[0] == loc[1] ? 1 : 2;
+    }
+    int find(bucket_t& b, Key_t& key) {
+      for (size_t s = 0; s < kWays; s++)
+        if (KT::equal(b.keys[s], key)) return s;
+      return -1;
+    }
+    int vacant(bucket_t& b) {
+      for (size_t s = 0; s < kWays; s++)
+        if (KT::empty(b.keys[s])) return s;
+      return -1;
+    }
+    Value_t& value_of(size_t b, size_t slot) { return values[b*kWays + slot]; }
+    void touch(bucket_t& b, size_t slot) {
+      uint32_t bit = 1u << slot;
+      if (!(__atomic_load_n(&b.ref, __ATOMIC_RELAXED) & bit))
+        __atomic_fetch_or(&b.ref, bit, __ATOMIC_RELAXED);
+    }
+    bool read(Key_t&, size_t[2], Value_t&, bool&);
+    bool put(Key_t&, Value_t&, bool);
+    template <typename F>
+    bool apply(Key_t&, F&&);
+
+    size_t nbuckets;
+    bucket_t* buckets;
+    Value_t* values;  // kWays per bucket
+    stripe_t* mutex;
+    size_t nlocks;
+    size_t locksize;
+    sharded_counter pairs;
+    sharded_counter evictions;
+};
+
+/* one lock-free lookup attempt, false if a writer changed either bucket meanwhile; found tells whether
+ * value holds the value of key then */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+bool ClockCache<Key_t, Value_t, Hasher, Lock>::read(Key_t& key, size_t idx[2], Value_t& value, bool& found) {
+  uint64_t version[2];
+  for (int i = 0; i < 2; i++) {
+    version[i] = __atomic_load_n(&mutex[idx[i]/locksize].version, __ATOMIC_ACQUIRE);
+    if (version[i] & 1) return false;
+  }
+  int hit = -1, slot = -1;
+  for (int i = 0; i < 2 && hit < 0; i++) {
+    slot = find(buckets[idx[i]], key);
+    if (slot >= 0) {
+      hit = i;
+      value = VT::load(value_of(idx[i], slot));
+    }
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  for (int i = 0; i < 2; i++) {
+    if (__atomic_load_n(&mutex[idx[i]/locksize].version, __ATOMIC_RELAXED) != version[i]) return false;
+  }
+  /* a bit set on a slot that was refilled meanwhile only gives that pair a second chance */
+  if (hit >= 0) touch(buckets[idx[hit]], slot);
+  found = hit >= 0;
+  return true;
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+bool ClockCache<Key_t, Value_t, Hasher, Lock>::Get(Key_t& key, Value_t& value) {
+  size_t idx[2];
+  locate(key, idx);
+  bool found;
+  backoff b;
+  while (!read(key, idx, value, found)) b.pause();
+  return found;
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+task<bool> ClockCache<Key_t, Value_t, Hasher, Lock>::GetCoro(Key_t& key, Value_t& value) {
+  size_t idx[2];
+  locate(key, idx);
+  co_await prefetch(&buckets[idx[0]], sizeof(bucket_t));
+  co_await prefetch(&buckets[idx[1]], sizeof(bucket_t));
+  bool found;
+  backoff b;
+  while (!read(key, idx, value, found)) b.pause();
+  co_return found;
+}
+
+/* Returns false if key is there, replacing its value if assign and copying it to value if not, or true
+ * after putting (key, value) into a free slot of either bucket or, with both full, into the slot the
+ * clock evicts. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+bool ClockCache<Key_t, Value_t, Hasher, Lock>::put(Key_t& key, Value_t& value, bool assign) {
+  size_t idx[2], loc[2];
+  locate(key, idx);
+  auto n = stripes(idx, loc);
+  for (size_t i = 0; i < n; i++) mutex[loc[i]].lock();
+
+  bool found = false;
+  for (int i = 0; i < 2 && !found; i++) {
+    int s = find(buckets[idx[i]], key);
+    if (s >= 0) {
+      if (assign) VT::store(value_of(idx[i], s), value);
+      else value = value_of(idx[i], s);
+      found = true;
+    }
+  }
+  if (!found) {
+    size_t b = 0, slot = 0;
+    bool placed = false;
+    for (int i = 0; i < 2 && !placed; i++) {
+      int s = vacant(buckets[idx[i]]);
+      if (s >= 0) {
+        b = idx[i];
+        slot = s;
+        placed = true;
+        pairs.add(1);
+      }
+    }
+    /* the hands take turns; every set bit they pass is cleared, so a full sweep of both buckets ends it */
+    for (size_t step = 0; !placed; step++) {
+      auto& bk = buckets[idx[step % 2]];
+      auto s = bk.hand;
+      bk.hand = (s + 1) % kWays;
+      uint32_t bit = 1u << s;
+      if (__atomic_load_n(&bk.ref, __ATOMIC_RELAXED) & bit) {
+        __atomic_fetch_and(&bk.ref, ~bit, __ATOMIC_RELAXED);
+        continue;
+      }
+      b = idx[step % 2];
+      slot = s;
+      placed = true;
+      evictions.add(1);
+    }
+    KT::copy(buckets[b].keys[slot], key);
+    value_of(b, slot) = value;
+    __atomic_fetch_and(&buckets[b].ref, ~(1u << slot), __ATOMIC_RELAXED);
+  }
+
+  for (size_t i = n; i > 0; i--) mutex[loc[i-1]].unlock();
+  return !found;
+}
+
+/* Runs fn on the value slot of key (see util/value_traits.h) under the value_locks of the stripes of both
+ * buckets; a hit sets the reference bit as Get does. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+template <typename F>
+bool ClockCache<Key_t, Value_t, Hasher, Lock>::apply(Key_t& key, F&& fn) {
+  size_t idx[2], loc[2];
+  locate(key, idx);
+  auto n = stripes(idx, loc);
+  value_lock<Value_t, stripe_t> lock[2];
+  for (size_t i = 0; i < n; i++) lock[i] = value_lock<Value_t, stripe_t>(mutex[loc[i]]);
+  for (int i = 0; i < 2; i++) {
+    int s = find(buckets[idx[i]], key);
+    if (s >= 0) {
+      touch(buckets[idx[i]], s);
+      return fn(&value_of(idx[i], s));
+    }
+  }
+  return false;
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+bool ClockCache<Key_t, Value_t, Hasher, Lock>::Delete(Key_t& key) {
+  size_t idx[2], loc[2];
+  locate(key, idx);
+  auto n = stripes(idx, loc);
+  for (size_t i = 0; i < n; i++) mutex[loc[i]].lock();
+  bool ret = false;
+  for (int i = 0; i < 2; i++) {
+    auto& bk = buckets[idx[i]];
+    int s = find(bk, key);
+    if (s >= 0) {
+      KT::clear(bk.keys[s]);
+      __atomic_fetch_and(&bk.ref, ~(1u << s), __ATOMIC_RELAXED);
+      pairs.add(-1);
+      ret = true;
+      break;
+    }
+  }
+  for (size_t i = n; i > 0; i--) mutex[loc[i-1]].unlock();
+  return ret;
+}
+
+/* a stripe of buckets at a time, copied under its shared lock */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+void ClockCache<Key_t, Value_t, Hasher, Lock>::ForEach(const function<void(const Pair<Key_t, Value_t>*, size_t)>& fn, size_t num_threads) {
+  size_t next = 0;
+  parallel_run(std::max(std::min(num_threads, nlocks), (size_t)1), [&](size_t){
+    std::vector<Pair<Key_t, Value_t>> buf(locksize * kWays);
+    size_t l;
+    while ((l = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)) < nlocks) {
+      size_t num = 0;
+      {
+        shared_lock<stripe_t> lock(mutex[l]);
+        for (size_t b = l*locksize; b < std::min((l+1)*locksize, nbuckets); b++) {
+          for (size_t s = 0; s < kWays; s++) {
+            if (KT::empty(buckets[b].keys[s])) continue;
+            KT::copy(buf[num].key, buckets[b].keys[s]);
+            buf[num].value = VT::load(value_of(b, s));
+            num++;
+          }
+        }
+      }
+      if (num) fn(buf.data(), num);
+    }
+  });
+}
@@ -0,0 +1,291 @@
+#pragma once
+#include <stddef.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <algorithm>
+#include <type_traits>
+#include "util/hash.h"
+#include "util/key_traits.h"
+#include "util/counter.h"
+#include "util/rwlock.h"
+#include "util/wait.h"
+
+using namespace std;
+
+/* Concurrent cuckoo filter (Fan et al., CoNEXT '14): approximate membership with deletes, storing
+ * only a Fp_t fingerprint per key in buckets of kSlots. The two buckets of a key are i1 = hash and
+ * i2 = hash(fingerprint) - i1, so a fingerprint can be moved to its other bucket without the key.
+ * Concurrency follows CuckooHash: writers take the versioned stripe locks of the buckets they change,
+ * in ascending order, and one displacement at a time searches its path without locks, takes all
+ * stripes on it, checks that the path is unchanged and moves the fingerprints from the free end back,
+ * so a fingerprint is always in one of its buckets. Contains takes no lock and retries when a stripe
+ * version changed under it. With uint8_t fingerprints a key costs about 8.4 bits at the kMaxLoad
+ * the filter is sized for (false positive rate about 3%), with uint16_t about 16.8 bits (0.01%).
+ * Add returns false when no displacement path is found: a filter cannot grow without its keys. */
+template <typename Key_t, typename Fp_t = uint8_t, typename Hasher = default_hash, typename Lock = default_lock>
+class CuckooFilter {
+  static_assert(std::is_same_v<Fp_t, uint8_t> || std::is_same_v<Fp_t, uint16_t>, "fingerprints are 8 or 16 bits");
+  using KT = KeyTraits<Key_t, Hasher>;
+  /* a bucket is one word with a fingerprint per lane, 0 for a free slot */
+  using bucket_t = std::conditional_t<sizeof(Fp_t) == 1, uint32_t, uint64_t>;
+  using stripe_t = versioned_lock<Lock>;
+  static const size_t kSlots = sizeof(bucket_t) / sizeof(Fp_t);
+  static const size_t kFpBits = 8*sizeof(Fp_t);
+  static constexpr bucket_t kLow = (bucket_t)~(bucket_t)0 / (Fp_t)~(Fp_t)0;  // 1 in every lane
+  static constexpr bucket_t kHigh = kLow << (kFpBits - 1);
+  const size_t kCuckooThreshold = 512;
+  const float kMaxLoad = 0.95;
+
+  /* bucket, slot and the fingerprint it held when the path was found */
+  struct hop_t {
+    size_t bucket;
+    size_t slot;
+    Fp_t fp;
+  };
+  using path_t = std::vector<hop_t>;
+
+  public:
+    CuckooFilter(size_t expected) {
+      nbuckets = (size_t)(expected / (kSlots * kMaxLoad)) + 1;
+      buckets = (bucket_t*)aligned_alloc(64, std::max(nbuckets * sizeof(bucket_t), (size_t)64));
+      if (!buckets) {
+        fprintf(stderr, "%s: failed to allocate %zu buckets\n", __func__, nbuckets);
+        exit(1);
+      }
+      memset((void*)buckets, 0, nbuckets * sizeof(bucket_t));
+      locksize = 1024;
+      nlocks = nbuckets / locksize + 1;
+      mutex = new stripe_t[nlocks];
+    }
+
+    ~CuckooFilter(void) {
+      free(buckets);
+      delete[] mutex;
+    }
+
+    bool Add(Key_t&);
+    bool Contains(Key_t&);
+    bool Remove(Key_t&);
+
+    size_t Size(void) { return items.sum(); }
+    size_t Capacity(void) { return nbuckets * kSlots; }
+    double Utilization(void) { return ((double)Size())/((double)Capacity())*100; }
+    size_t Bytes(void) { return nbuckets * sizeof(bucket_t); }
+
+  private:
+    void locate(Key_t& key, Fp_t& fp, size_t& i1, size_t& i2) {
+      auto key_hash = KT::hash(key);
+      fp = (Fp_t)(key_hash >> (64 - kFpBits));
+      if (fp == 0) fp = 1;
+      i1 = ((key_hash & 0xffffffffUL) * nbuckets) >> 32;
+      i2 = alt(i1, fp);
+    }
+    /* (h(fp) - idx) mod nbuckets maps i1 and i2 onto each other for any number of buckets */
+    size_t alt(size_t idx, Fp_t fp) {
+      size_t h = ((unsigned __int128)(fp * 0x9e3779b97f4a7c15UL) * nbuckets) >> 64;
+      return h >= idx ? h - idx : h + nbuckets - idx;
+    }
+
+    static Fp_t lane(bucket_t b, size_t slot) { return (Fp_t)(b >> (slot * kFpBits)); }
+    static bucket_t with(bucket_t b, size_t slot, Fp_t fp) {
+      auto shift = slot * kFpBits;
+      return (b & ~((bucket_t)(Fp_t)~(Fp_t)0 << shift)) | ((bucket_t)fp << shift);
+    }
+    /* any lane of b equal to fp (0 for a free slot), all lanes at once */
+    static bool has(bucket_t b, Fp_t fp) {
+      auto x = b ^ (kLow * fp);
+      return ((x - kLow) & ~x & kHigh) != 0;
+    }
+    static int find(bucket_t b, Fp_t fp) {
+      for (size_t s = 0; s < kSlots; s++)
+        if (lane(b, s) == fp) return s;
+      return -1;
+    }
+
+    bucket_t load(size_t idx) { return __atomic_load_n(&buckets[idx], __ATOMIC_RELAXED); }
+    void store(size_t idx, bucket_t b) { __atomic_store_n(&buckets[idx], b, __ATOMIC_RELAXED); }
+    bool put(size_t idx, Fp_t fp);
+    bool read(Fp_t fp, size_t i1, size_t i2, bool& ret);
+    bool displace(Fp_t, size_t, size_t);
+    path_t find_path(size_t);
+    void execute_path(path_t&, Fp_t);
+
+    size_t nbuckets;
+    bucket_t* buckets;
+    sharded_counter items;
+    std::mutex displacement;  // one displacement at a time, as resizing_lock in CuckooHash
+    size_t victim = 0;  // next slot to evict from, under displacement
+    stripe_t *mutex;
+    int nlocks;
+    int locksize;
+};
+
+/* puts fp into a free slot of bucket idx, whose stripe the caller holds */
+template <typename Key_t, typename Fp_t, typename Hasher, typename Lock>
+bool CuckooFilter<Key_t, Fp_t, Hasher, Lock>::put(size_t idx, Fp_t fp) {
+  auto b = load(idx);
+  auto slot = find(b, 0);
+  if (slot < 0) return false;
+  store(idx, with(b, slot, fp));
+  return true;
+}
+
+template <typename Key_t, typename Fp_t, typename Hasher, typename Lock>
+bool CuckooFilter<Key_t, Fp_t, Hasher, Lock>::Add(Key_t& key) {
+  Fp_t fp;
+  size_t i1, i2;
+  locate(key, fp, i1, i2);
+  {
+    auto lo = std::min(i1, i2)/locksize;
+    auto hi = std::max(i1, i2)/locksize;
+    unique_lock<stripe_t> lo_lock(mutex[lo]);
+    unique_lock<stripe_t> hi_lock(mutex[hi], defer_lock);
+    if (hi != lo) hi_lock.lock();
+    if (put(i1, fp) || put(i2, fp)) {
+      items.add(1);
+      return true;
+    }
+  }
+  if (!displace(fp, i1, i2)) return false;
+  items.add(1);
+  return true;
+}
+
+/* Both buckets are full: finds a chain of fingerprints, each of which moves to its other bucket, that
+ * ends in a free slot, and shifts it by one to free a slot in i1 or i2. */
+template <typename Key_t, typename Fp_t, typename Hasher, typename Lock>
+bool CuckooFilter<Key_t, Fp_t, Hasher, Lock>::displace(Fp_t fp, size_t i1, size_t i2) {
+  lock_guard<std::mutex> guard(displacement);
+  while (true) {
+    auto path = find_path(victim++ % 2 ? i2 : i1);
+    if (path.size() == 0) {
+      path = find_path(victim % 2 ? i2 : i1);
+      if (path.size() == 0) return false;
+    }
+
+    vector<size_t> lock_loc;
+    for (auto& h: path) lock_loc.push_back(h.bucket/locksize);
+    lock_loc.push_back(i1/locksize);
+    lock_loc.push_back(i2/locksize);
+    sort(begin(lock_loc), end(lock_loc));
+    lock_loc.erase(unique(lock_loc.begin(), lock_loc.end()), lock_loc.end());
+    for (auto i: lock_loc) mutex[i].lock();
+
+    /* a Remove may have freed a slot meanwhile, any other writer changes the path */
+    bool done = put(i1, fp) || put(i2, fp);
+    bool valid = true;
+    if (!done) {
+      for (auto& h: path) {
+        if (lane(load(h.bucket), h.slot) != h.fp) {
+          valid = false;
+          break;
+        }
+      }
+      if (valid) execute_path(path, fp);
+    }
+    for (auto i: lock_loc) mutex[i].unlock();
+    if (done || valid) return true;
+  }
+}
+
+/* Walks from bucket target, evicting a slot in turn from every full bucket, until a bucket has a free
+ * slot, never moving a slot twice; empty if that takes more than kCuckooThreshold hops or every slot of
+ * a bucket it comes back to is already on the path. */
+template <typename Key_t, typename Fp_t, typename Hasher, typename Lock>
+typename CuckooFilter<Key_t, Fp_t, Hasher, Lock>::path_t CuckooFilter<Key_t, Fp_t, Hasher, Lock>::find_path(size_t target) {
+  path_t path;
+  path.reserve(kCuckooThreshold);
+  auto cur = target;
+  for (size_t i = 0; i < kCuckooThreshold; i++) {
+    auto b = load(cur);
+    auto slot = find(b, 0);
+    if (slot >= 0) {
+      path.push_back({cur, (size_t)slot, 0});
+      return path;
+    }
+    /* the next slot of cur the walk has not moved yet */
+    size_t s = victim++ % kSlots;
+    size_t tried = 0;
+    for (; tried < kSlots; tried++, s = (s + 1) % kSlots) {
+      bool moved = false;
+      for (auto& h: path) moved |= (h.bucket == cur && h.slot == s);
+      if (!moved) break;
+    }
+    if (tried == kSlots) {
+      path.resize(0);
+      return path;
+    }
+    auto fp = lane(b, s);
+    path.push_back({cur, s, fp});
+    cur = alt(cur, fp);
+  }
+  path.resize(0);
+  return path;
+}
+
+/* from the free end back, so every fingerprint on the path is in place before its old slot is reused */
+template <typename Key_t, typename Fp_t, typename Hasher, typename Lock>
+void CuckooFilter<Key_t, Fp_t, Hasher, Lock>::execute_path(path_t& path, Fp_t fp) {
+  for (int i = path.size()-1; i > 0; --i) {
+    auto& h = path[i];
+    store(h.bucket, with(load(h.bucket), h.slot, path[i-1].fp));
+  }
+  store(path[0].bucket, with(load(path[0].bucket), path[0].slot, fp));
+}
+
+/* one optimistic read of both buckets; false if a writer got in the way */
+template <typename Key_t, typename Fp_t, typename Hasher, typename Lock>
+bool CuckooFilter<Key_t, Fp_t, Hasher, Lock>::read(Fp_t fp, size_t i1, size_t i2, bool& ret) {
+  size_t idx[2] = {i1, i2};
+  uint64_t version[2];
+  for (int i = 0; i < 2; i++) {
+    version[i] = __atomic_load_n(&mutex[idx[i]/locksize].version, __ATOMIC_ACQUIRE);
+    if (version[i] & 1) return false;
+  }
+  ret = has(load(i1), fp) || has(load(i2), fp);
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  for (int i = 0; i < 2; i++) {
+    if (__atomic_load_n(&mutex[idx[i]/locksize].version, __ATOMIC_RELAXED) != version[i]) return false;
+  }
+  return true;
+}
+
+template <typename Key_t, typename Fp_t, typename Hasher, typename Lock>
+bool CuckooFilter<Key_t, Fp_t, Hasher, Lock>::Contains(Key_t& key) {
+  Fp_t fp;
+  size_t i1, i2;
+  locate(key, fp, i1, i2);
+  bool ret;
+  backoff b;
+  while (!read(fp, i1, i2, ret)) b.pause();
+  return ret;
+}
+
+/* removes one copy of the fingerprint of key; removing a key that was never added may remove another
+ * key with the same fingerprint and buckets */
+template <typename Key_t, typename Fp_t, typename Hasher, typename Lock>
+bool CuckooFilter<Key_t, Fp_t, Hasher, Lock>::Remove(Key_t& key) {
+  Fp_t fp;
+  size_t i1, i2;
+  locate(key, fp, i1, i2);
+  auto lo = std::min(i1, i2)/locksize;
+  auto hi = std::max(i1, i2)/locksize;
+  unique_lock<stripe_t> lo_lock(mutex[lo]);
+  unique_lock<stripe_t> hi_lock(mutex[hi], defer_lock);
+  if (hi != lo) hi_lock.lock();
+  for (auto idx: {i1, i2}) {
+    auto b = load(idx);
+    auto slot = find(b, fp);
+    if (slot >= 0) {
+      store(idx, with(b, slot, 0));
+      items.add(-1);
+      return true;
+    }
+  }
+  return false;
+}
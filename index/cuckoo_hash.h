@@ -9,392 +9,383 @@
 #include <algorithm>
 #include "util/pair.h"
 #include "util/hash.h"
+#include "util/key_traits.h"
+#include "util/hash_batch.h"
+#include "util/batch.h"
+#include "util/parallel.h"
+#include "util/counter.h"
+#include "util/layout.h"
+#include "util/rwlock.h"
+#include "util/wait.h"
 #include "index//interface.h"
 
 using namespace std;
 
-template <typename Key_t>
-class CuckooHash : public Hash<Key_t> {
-  size_t _seed = 0xc70f6907UL;
+template <typename Key_t, typename Value_t = default_value, typename Hasher = default_hash, typename Layout = default_layout, typename Lock = default_lock>
+class CuckooHash final : public Hash<Key_t, Value_t> {
+  /* the two cuckoo hash functions are the Hasher policy under two seeds */
+  const size_t kSeed[2] = {0xc70f6907UL, 0x9ae16a3b2f90404fUL};
   const size_t kCuckooThreshold = 512;
   const size_t kNumHash = 2;
   const float kResizingFactor = 1.2;
   //const float kResizingFactor = 2;
   const size_t kMaxGrows = 128;
+  const size_t kBulkPartition = 4096;  // slots per BulkLoad partition
+  const size_t kRehashChunk = 4096;  // old slots per rehash chunk
+  using KT = KeyTraits<Key_t, Hasher>;
+  using VT = ValueTraits<Value_t>;
+  using table_t = typename Layout::template table<Key_t, Value_t>;
+  /* slots of a displacement path and the pairs they held when the path was found */
+  using path_t = std::vector<std::pair<size_t, Pair<Key_t, Value_t>>>;
+
+  /* stripe lock with the version Get validates its lock-free reads against (see util/rwlock.h) */
+  using stripe_t = versioned_lock<Lock>;
+
+  /* a table with its capacity and stripes, replaced as a whole once a resize is done: readers and writers
+   * take one snapshot of it, and writers check under their stripe locks that it is still the current one */
+  struct view_t {
+    table_t* table;
+    size_t capacity;
+    stripe_t* mutex;
+  };
 
   public:
-    CuckooHash(void): capacity{0}, table{nullptr} {
-        memset(&pushed, 0, sizeof(Pair<Key_t>)*2);
+    CuckooHash(void): view{nullptr} {
+        memset(&pushed, 0, sizeof(Pair<Key_t, Value_t>)*2);
     }
 
-    CuckooHash(size_t _capacity): capacity{_capacity}, table{new Pair<Key_t>[capacity]} {
-        memset(&pushed, 0, sizeof(Pair<Key_t>)*2);
+    CuckooHash(size_t _capacity) {
+        memset(&pushed, 0, sizeof(Pair<Key_t, Value_t>)*2);
         locksize = 256;
-        nlocks = capacity / locksize + 1;
-        mutex = new std::shared_mutex[nlocks];
+        nlocks = _capacity / locksize + 1;
+        view = new view_t{new table_t(_capacity), _capacity, new stripe_t[nlocks]};
+    }
+
+    /* sized for expected pairs at load_factor, which Reserve and BulkLoad plan with as well */
+    CuckooHash(size_t expected, float _load_factor): CuckooHash((size_t)(expected / _load_factor) + 1) {
+        load_factor = _load_factor;
     }
 
     ~CuckooHash(void){
-        delete[] table;
+        if (view != nullptr) retired.push_back(view);
+        for (auto v: retired) {
+            delete v->table;
+            delete[] v->mutex;
+            delete v;
+        }
     }
 
-    void Insert(Key_t&, Value_t);
+    void Insert(Key_t& key, Value_t value){
+        put<false>(key, value, false);
+        pairs.add(1);
+    }
+    bool Upsert(Key_t& key, Value_t value){
+        bool inserted = put<true>(key, value, true);
+        if (inserted) pairs.add(1);
+        return inserted;
+    }
+    bool GetOrInsert(Key_t& key, Value_t& value){
+        bool inserted = put<true>(key, value, false);
+        if (inserted) pairs.add(1);
+        return inserted;
+    }
     bool Update(Key_t&, Value_t);
+    bool FetchAdd(Key_t& key, Value_t delta, Value_t* prev = nullptr){
+        return apply(key, [&](Value_t* v){
+            auto old = VT::fetch_add(*v, delta);
+            if(prev) *prev = old;
+            return true;
+        });
+    }
+    bool CompareExchange(Key_t& key, Value_t& expected, Value_t desired){
+        return apply(key, [&](Value_t* v){
+            return VT::compare_exchange(*v, expected, desired);
+        });
+    }
+    template <typename F>
+    bool Modify(Key_t& key, F&& fn){
+        return apply(key, [&](Value_t* v){
+            auto old = VT::load(*v);
+            while(!VT::compare_exchange(*v, old, fn(old)));
+            return true;
+        });
+    }
+    bool Modify(Key_t& key, const function<Value_t(Value_t)>& fn){
+        return Modify<const function<Value_t(Value_t)>&>(key, fn);
+    }
     bool Delete(Key_t&);
-    char* Get(Key_t&);
-    double Utilization(void);
-    size_t Capacity(void){ return capacity;} 
+    bool Get(Key_t&, Value_t&);
+    void InsertBatch(Pair<Key_t, Value_t>*, size_t);
+    size_t UpdateBatch(Pair<Key_t, Value_t>*, size_t);
+    size_t DeleteBatch(Pair<Key_t, Value_t>*, size_t);
+    void Reserve(size_t num){
+        reserve(num, 1);
+    }
+    void BulkLoad(Pair<Key_t, Value_t>*, size_t, size_t num_threads = 1);
+    task<bool> GetCoro(Key_t&, Value_t&);
+    template <typename F>
+    void ForEach(F&&, size_t num_threads = 1);
+    void ForEach(const function<void(const Pair<Key_t, Value_t>*, size_t)>& fn, size_t num_threads = 1){
+        ForEach<const function<void(const Pair<Key_t, Value_t>*, size_t)>&>(fn, num_threads);
+    }
+    size_t Size(void){ return pairs.sum(); }
+    double Utilization(void){ return ((double)Size())/((double)load_view()->capacity)*100; }
+    size_t Capacity(void){ return load_view()->capacity;} 
     void FindAnyway(Key_t&){ }
 
   private:
-    bool insert4resize(Key_t&, Value_t);
-    bool resize(void);
-    std::vector<std::pair<size_t, Key_t>> find_path(size_t);
-    std::vector<std::pair<size_t, string>> find_path(size_t, bool);
+    template <typename F>
+    bool apply(Key_t&, F&&);
+    template <bool kUnique>
+    bool put(Key_t&, Value_t&, bool);
+    template <typename Op, typename Fallback>
+    size_t batch(Pair<Key_t, Value_t>*, size_t, Op&&, Fallback&&);
+    bool insert4resize(const view_t&, Key_t&, Value_t, size_t, size_t);
+    bool read(Key_t&, size_t, size_t, Value_t&, bool&);
+    bool resize(size_t, size_t num_threads = 1);
+    /* waits out a running resize or displacement, helping with the rehash meanwhile */
+    void wait_resize(void){
+      resize_wait.wait_until([this]{
+        if (!__atomic_load_n(&resizing_lock, __ATOMIC_SEQ_CST)) return true;
+        rehash.help();
+        return false;
+      });
+    }
+    void end_resize(void){
+      __atomic_store_n(&resizing_lock, 0, __ATOMIC_SEQ_CST);
+      resize_wait.wake();
+    }
+    view_t* load_view(void){ return __atomic_load_n(&view, __ATOMIC_ACQUIRE); }
+    void reserve(size_t, size_t);
+    path_t find_path(const view_t&, size_t);
     bool validate_path(std::vector<size_t>&);
-    bool execute_path(std::vector<std::pair<size_t,Key_t>>&);
-    bool execute_path(std::vector<std::pair<size_t,string>>&, bool);
-    bool execute_path(std::vector<std::pair<size_t,Key_t>>&, Key_t&, Value_t);
-    bool execute_path(std::vector<std::pair<size_t,string>>&, Key_t&, Value_t, bool);
-
-    size_t capacity;
-    Pair<Key_t>* table;
-    Pair<Key_t> pushed[2];
-    Pair<Key_t> temp;
+    bool execute_path(const view_t&, path_t&);
+    bool execute_path(const view_t&, path_t&, Key_t&, Value_t);
 
-    size_t old_cap;
-    Pair<Key_t>* old_tab;
+    float load_factor = 0.4;  // planned load of Reserve and BulkLoad, two choices get stuck around 0.5
+    sharded_counter pairs;
+    Pair<Key_t, Value_t> pushed[2];
+    Pair<Key_t, Value_t> temp;
 
     int resizing_lock = 0;
-    std::shared_mutex *mutex;
+    int scanners = 0;  // running ForEach calls, displacements and resizes wait for them
+    chunk_pool rehash;  // threads waiting for a resize help with the rehash
+    wait_queue resize_wait;  // and sleep on it once there is nothing left to help with
+    view_t* view;
+    /* views replaced by resizes: writers blocked on their stripe locks and lookups still in them go on
+     * until they see the new view, so they are freed with the index */
+    std::vector<view_t*> retired;
     int nlocks;
     int locksize;
 };
 
-template <typename Key_t>
-void CuckooHash<Key_t>::Insert(Key_t& key, Value_t value) {
-  size_t f_hash, s_hash;
-  if constexpr(sizeof(Key_t) > 8){
-      f_hash = hash_funcs[0](key, sizeof(Key_t), _seed);
-      s_hash = hash_funcs[1](key, sizeof(Key_t), _seed);
-  }
-  else{
-      f_hash = hash_funcs[0](&key, sizeof(Key_t), _seed);
-      s_hash = hash_funcs[1](&key, sizeof(Key_t), _seed);
-  }
-
+/* Insert (kUnique unset) places key blindly. Upsert/GetOrInsert (kUnique set) return false if key was
+ * already there, overwriting its value if assign is set and copying it to value if not; both candidate
+ * slots are checked and filled under their stripe locks, which the displacement path below takes as well. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+template <bool kUnique>
+bool CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::put(Key_t& key, Value_t& value, bool assign) {
+  auto f_hash = KT::hash(key, kSeed[0]);
+  auto s_hash = KT::hash(key, kSeed[1]);
 
 RETRY:
-  while (resizing_lock == 1) {
-    asm("nop");
-  }
-  auto f_idx = f_hash % capacity;
-  auto s_idx = s_hash % capacity;
-
-
-  {
-    unique_lock<shared_mutex> f_lock(mutex[f_idx/locksize]);
-    if constexpr(sizeof(Key_t) > 8){
-	if(memcmp(table[f_idx].key, INVALID<Key_t>, sizeof(Key_t)) == 0){
-	    memcpy(table[f_idx].key, key, sizeof(Key_t));
-	    memcpy(&table[f_idx].value, &value, sizeof(Value_t));
-	    return;
-	}
+  wait_resize();
+  auto v = load_view();
+  auto table = v->table;
+  auto f_idx = f_hash % v->capacity;
+  auto s_idx = s_hash % v->capacity;
+
+  if constexpr (kUnique) {
+    auto lo = std::min(f_idx, s_idx)/locksize;
+    auto hi = std::max(f_idx, s_idx)/locksize;
+    unique_lock<stripe_t> lo_lock(v->mutex[lo]);
+    unique_lock<stripe_t> hi_lock(v->mutex[hi], defer_lock);
+    if (hi != lo) hi_lock.lock();
+    /* f_idx and s_idx are only valid for the view they were computed for */
+    if (v != load_view()) goto RETRY;
+    for (auto idx: {f_idx, s_idx}) {
+      if (KT::equal(table->key(idx), key)) {
+        if (assign) table->value(idx) = value;
+        else value = table->value(idx);
+        return false;
+      }
     }
-    else{
-	if(memcmp(&table[f_idx].key, &INVALID<Key_t>, sizeof(Key_t)) == 0){
-	    memcpy(&table[f_idx].key, &key, sizeof(Key_t));
-	    memcpy(&table[f_idx].value, &value, sizeof(Value_t));
-	    return;
-	}
+    for (auto idx: {f_idx, s_idx}) {
+      if (KT::empty(table->key(idx))) {
+        KT::copy(table->key(idx), key);
+        table->value(idx) = value;
+        return true;
+      }
     }
-  }
-  {
-    unique_lock<shared_mutex> s_lock(mutex[s_idx/locksize]);
-    if constexpr(sizeof(Key_t) > 8){
-	if(memcmp(table[s_idx].key, INVALID<Key_t>, sizeof(Key_t)) == 0){
-	    memcpy(table[s_idx].key, key, sizeof(Key_t));
-	    memcpy(&table[s_idx].value, &value, sizeof(Value_t));
-	    return;
-	}
+  } else {
+    {
+      unique_lock<stripe_t> f_lock(v->mutex[f_idx/locksize]);
+      if (v != load_view()) goto RETRY;
+      if(KT::empty(table->key(f_idx))){
+	KT::copy(table->key(f_idx), key);
+	table->value(f_idx) = value;
+	return true;
+      }
     }
-    else{
-	if(memcmp(&table[s_idx].key, &INVALID<Key_t>, sizeof(Key_t)) == 0){
-	    memcpy(&table[s_idx].key, &key, sizeof(Key_t));
-	    memcpy(&table[s_idx].value, &value, sizeof(Value_t));
-	    return;
-	}
+    {
+      unique_lock<stripe_t> s_lock(v->mutex[s_idx/locksize]);
+      if (v != load_view()) goto RETRY;
+      if(KT::empty(table->key(s_idx))){
+	KT::copy(table->key(s_idx), key);
+	table->value(s_idx) = value;
+	return true;
+      }
     }
-
   }
 
   { // Failed to insert... Doing Cuckooing...
     int unlocked = 0;
     if (CAS(&resizing_lock, &unlocked, 1)) {
+	/* pairs must not move between stripes under a running ForEach */
+	if (__atomic_load_n(&scanners, __ATOMIC_SEQ_CST)) {
+	    end_resize();
+	    goto RETRY;
+	}
+	/* a resize may have been done since f_idx and s_idx were computed */
+	if (v != load_view()) {
+	    end_resize();
+	    goto RETRY;
+	}
 #ifdef BREAKDOWN
 	clock_gettime(CLOCK_MONOTONIC, &t_start);
 #endif
 PATH_RETRY:
-	    if constexpr(sizeof(Key_t) > 8){
-		    auto path1 = find_path(f_idx, true);
-		    auto path2 = find_path(s_idx, true);
-		    if (path1.size() != 0 || path2.size() != 0) {
-			    auto path = &path1;
-			    if(path1.size() == 0
-					    || (path2.size() != 0 && path2.size() < path1.size())
-					    || (path2.size() != 0 && (memcmp(path1[0].second.c_str(), INVALID<Key_t>, sizeof(Key_t)) == 0))){
-				    path = &path2;
-			    }
+	    auto path1 = find_path(*v, f_idx);
+	    auto path2 = find_path(*v, s_idx);
+	    if (path1.size() != 0 || path2.size() != 0) {
+		    auto path = &path1;
+		    if(path1.size() == 0
+				    || (path2.size() != 0 && path2.size() < path1.size())
+				    || (path2.size() != 0 && KT::empty(path1[0].second.key))){
+			    path = &path2;
+		    }
 
-			    auto id = 0;
-			    vector<size_t> lock_loc;
-			    for (auto p: *path) {
-				    lock_loc.push_back(p.first/locksize);
-			    }
-			    sort(begin(lock_loc), end(lock_loc));
-			    lock_loc.erase( unique( lock_loc.begin(), lock_loc.end() ), lock_loc.end() );
-			    unique_lock<shared_mutex> *lock[kCuckooThreshold];
-			    for (auto i :lock_loc) {
-				    lock[id++] = new unique_lock<shared_mutex>(mutex[i]);
+		    auto id = 0;
+		    vector<size_t> lock_loc;
+		    for (auto& p: *path) {
+			    lock_loc.push_back(p.first/locksize);
+		    }
+		    if constexpr (kUnique) {
+			    lock_loc.push_back(f_idx/locksize);
+			    lock_loc.push_back(s_idx/locksize);
+		    }
+		    sort(begin(lock_loc), end(lock_loc));
+		    lock_loc.erase( unique( lock_loc.begin(), lock_loc.end() ), lock_loc.end() );
+		    unique_lock<stripe_t> *lock[kCuckooThreshold];
+		    for (auto i :lock_loc) {
+			    lock[id++] = new unique_lock<stripe_t>(v->mutex[i]);
+		    }
+		    for (auto& p : *path) {
+			    if(!KT::equal(table->key(p.first), p.second.key)){
+				    for(int i=0; i<id; i++)
+					    delete lock[i];
+				    goto PATH_RETRY;
 			    }
-			    for (auto p : *path) {
-				    if(strcmp(table[p.first].key, p.second.c_str()) != 0){
-					    for(int i=0; i<id; i++)
+		    }
+		    if constexpr (kUnique) {
+			    /* another writer may have put key in while the path was searched */
+			    for (auto idx: {f_idx, s_idx}) {
+				    if (KT::equal(table->key(idx), key)) {
+					    end_resize();
+					    if (assign) table->value(idx) = value;
+					    else value = table->value(idx);
+					    for (int i = 0; i < id; ++i)
 						    delete lock[i];
-					    goto PATH_RETRY;
+					    return false;
 				    }
-
-			    }
-			    resizing_lock = 0;
-			    execute_path(*path, key, value, true);
-			    for (int i = 0; i < id; ++i) {
-				    delete lock[i];
 			    }
-#ifdef BREAKDOWN
-			    clock_gettime(CLOCK_MONOTONIC, &t_end);
-			    cuckoo_time += t_end.tv_nsec - t_start.tv_nsec + (t_end.tv_sec - t_start.tv_sec) * 1000000000;
-#endif
-			    return;
-		    } else {
-			    resize();
-			    resizing_lock = 0;
-#ifdef BREAKDOWN
-			    clock_gettime(CLOCK_MONOTONIC, &t_end);
-			    split_time += t_end.tv_nsec - t_start.tv_nsec + (t_end.tv_sec - t_start.tv_sec) * 1000000000;
-#endif
 		    }
-	    }
-	    else{
-
-		    auto path1 = find_path(f_idx);
-		    auto path2 = find_path(s_idx);
-		    if (path1.size() != 0 || path2.size() != 0) {
-			    auto path = &path1;
-			    if(path1.size() == 0
-					    || (path2.size() != 0 && path2.size() < path1.size())
-					    || (path2.size() != 0 && memcmp(&path1[0].second, &INVALID<Key_t>, sizeof(Key_t)) == 0)){
-				    path = &path2;
-			    }
-
-			    auto id = 0;
-			    vector<size_t> lock_loc;
-			    for (auto p: *path) {
-				    lock_loc.push_back(p.first/locksize);
-			    }
-			    sort(begin(lock_loc), end(lock_loc));
-			    lock_loc.erase( unique( lock_loc.begin(), lock_loc.end() ), lock_loc.end() );
-			    unique_lock<shared_mutex> *lock[kCuckooThreshold];
-			    for (auto i :lock_loc) {
-				    lock[id++] = new unique_lock<shared_mutex>(mutex[i]);
-			    }
-			    for (auto p : *path) {
-				    if constexpr(sizeof(Key_t) > 8){
-					    if(memcmp(table[p.first].key, p.second, sizeof(Key_t)) != 0){
-						    for(int i=0; i<id; i++)
-							    delete lock[i];
-						    goto PATH_RETRY;
-					    }
-				    }
-				    else{
-					    if(memcmp(&table[p.first].key, &p.second, sizeof(Key_t)) != 0){
-						    for(int i=0; i<id; i++)
-							    delete lock[i];
-						    goto PATH_RETRY;
-					    }
-				    }
-
-			    }
-			    resizing_lock = 0;
-			    execute_path(*path, key, value);
-			    for (int i = 0; i < id; ++i) {
-				    delete lock[i];
-			    }
+		    end_resize();
+		    execute_path(*v, *path, key, value);
+		    for (int i = 0; i < id; ++i) {
+			    delete lock[i];
+		    }
 #ifdef BREAKDOWN
-			    clock_gettime(CLOCK_MONOTONIC, &t_end);
-			    cuckoo_time += t_end.tv_nsec - t_start.tv_nsec + (t_end.tv_sec - t_start.tv_sec) * 1000000000;
+		    clock_gettime(CLOCK_MONOTONIC, &t_end);
+		    cuckoo_time += t_end.tv_nsec - t_start.tv_nsec + (t_end.tv_sec - t_start.tv_sec) * 1000000000;
 #endif
-
-			    return;
-		    } else {
-			    resize();
-			    resizing_lock = 0;
+		    return true;
+	    } else {
+		    resize(v->capacity * kResizingFactor);
+		    end_resize();
 #ifdef BREAKDOWN
-			    clock_gettime(CLOCK_MONOTONIC, &t_end);
-			    split_time += t_end.tv_nsec - t_start.tv_nsec + (t_end.tv_sec - t_start.tv_sec) * 1000000000;
+		    clock_gettime(CLOCK_MONOTONIC, &t_end);
+		    split_time += t_end.tv_nsec - t_start.tv_nsec + (t_end.tv_sec - t_start.tv_sec) * 1000000000;
 #endif
-		    }
 	    }
     }
   }
   goto RETRY;
 }
 
-template <typename Key_t>
-bool CuckooHash<Key_t>::insert4resize(Key_t& key, Value_t value) {
-  size_t f_hash, s_hash;
-  if constexpr(sizeof(Key_t) > 8){
-      f_hash = hash_funcs[0](key, sizeof(Key_t), _seed);
-      s_hash = hash_funcs[1](key, sizeof(Key_t), _seed);
-  }
-  else{
-      f_hash = hash_funcs[0](&key, sizeof(Key_t), _seed);
-      s_hash = hash_funcs[1](&key, sizeof(Key_t), _seed);
-  }
-
-  auto f_idx = f_hash % capacity;
-  auto s_idx = s_hash % capacity;
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::insert4resize(const view_t& v, Key_t& key, Value_t value, size_t f_hash, size_t s_hash) {
+  auto table = v.table;
+  auto f_idx = f_hash % v.capacity;
+  auto s_idx = s_hash % v.capacity;
 
-  if constexpr(sizeof(Key_t) > 8){
-      if(memcmp(table[f_idx].key, INVALID<Key_t>, sizeof(Key_t)) == 0){
-	  memcpy(table[f_idx].key, key, sizeof(Key_t));
-	  memcpy(&table[f_idx].value, &value, sizeof(Value_t));
-      }
-      else if(memcmp(table[s_idx].key, INVALID<Key_t>, sizeof(Key_t)) == 0){
-	  memcpy(table[s_idx].key, key, sizeof(Key_t));
-	  memcpy(&table[s_idx].value, &value, sizeof(Value_t));
-      }
-      else{
-	  auto path1 = find_path(f_idx, true);
-	  auto path2 = find_path(s_idx, true);
-	  memcpy(pushed[0].key, key, sizeof(Key_t));
-	  memcpy(&pushed[0].value, &value, sizeof(Value_t));
-	  if(path1.size() == 0 && path2.size() == 0)
-		  return false;
-	  else{
-		  if(path1.size() == 0)
-			  execute_path(path2, true);
-		  else if(path2.size() == 0)
-			  execute_path(path1, true);
-		  else if(path1.size() < path2.size())
-			  execute_path(path1, true);
-		  else
-			  execute_path(path2, true);
-	  }
-      }
+  if(KT::empty(table->key(f_idx))){
+      KT::copy(table->key(f_idx), key);
+      table->value(f_idx) = value;
+  }
+  else if(KT::empty(table->key(s_idx))){
+      KT::copy(table->key(s_idx), key);
+      table->value(s_idx) = value;
   }
   else{
-      if(memcmp(&table[f_idx].key, &INVALID<Key_t>, sizeof(Key_t)) == 0){
-	  memcpy(&table[f_idx].key, &key, sizeof(Key_t));
-	  memcpy(&table[f_idx].value, &value, sizeof(Value_t));
-      }
-      else if(memcmp(&table[s_idx].key, &INVALID<Key_t>, sizeof(Key_t)) == 0){
-	  memcpy(&table[s_idx].key, &key, sizeof(Key_t));
-	  memcpy(&table[s_idx].value, &value, sizeof(Value_t));
-      }
+      auto path1 = find_path(v, f_idx);
+      auto path2 = find_path(v, s_idx);
+      KT::copy(pushed[0].key, key);
+      pushed[0].value = value;
+      if(path1.size() == 0 && path2.size() == 0)
+	      return false;
       else{
-	  auto path1 = find_path(f_idx);
-	  auto path2 = find_path(s_idx);
-	  memcpy(&pushed[0].key, &key, sizeof(Key_t));
-	  memcpy(&pushed[0].value, &value, sizeof(Value_t));
-	  if(path1.size() == 0 && path2.size() == 0)
-		  return false;
-	  else{
-		  if(path1.size() == 0)
-			  execute_path(path2);
-		  else if(path2.size() == 0)
-			  execute_path(path1);
-		  else if(path1.size() < path2.size())
-			  execute_path(path1);
-		  else
-			  execute_path(path2);
-	  }
+	      if(path1.size() == 0)
+		      execute_path(v, path2);
+	      else if(path2.size() == 0)
+		      execute_path(v, path1);
+	      else if(path1.size() < path2.size())
+		      execute_path(v, path1);
+	      else
+		      execute_path(v, path2);
       }
   }
 
   return true;
 }
 
-template <typename Key_t>
-vector<pair<size_t,string>> CuckooHash<Key_t>::find_path(size_t target, bool flag) {
-  vector<pair<size_t,string>> path;
-  path.reserve(kCuckooThreshold);
-  string key_v(table[target].key);
-  path.emplace_back(target, key_v);
-  auto cur = target;
-  auto i = 0;
-  do {
-    const char* key = table[cur].key;
-    if(memcmp(key, INVALID<Key_t>, sizeof(Key_t)) == 0){ 
-	    break;
-    }
-    auto f_hash = hash_funcs[0](key, sizeof(Key_t), _seed);
-    auto s_hash = hash_funcs[1](key, sizeof(Key_t), _seed);
-
-    auto f_idx = f_hash % capacity;
-    auto s_idx = s_hash % capacity;
-
-    if (f_idx == cur) {
-	    string s_idx_key(table[s_idx].key);
-	    path.emplace_back(s_idx, s_idx_key);
-	    cur = s_idx;
-    } else if (s_idx == cur) {
-	    string f_idx_key(table[f_idx].key);
-	    path.emplace_back(f_idx, f_idx_key);
-	    cur = f_idx;
-    } else {  // something terribly wrong
-	    cout << "E: " << f_idx << " " << s_idx << " " << cur << " " << target << endl;
-	    cout << key << endl;
-	    exit(1);
-    }
-    i++;
-  } while (i < kCuckooThreshold);
-
-  if (i == kCuckooThreshold) {
-    path.resize(0);
-  }
-
-  return move(path);
-}
-
-
-
-template <typename Key_t>
-vector<pair<size_t,Key_t>> CuckooHash<Key_t>::find_path(size_t target) {
-  vector<pair<size_t,Key_t>> path;
+/* Follows the chain of displacements starting at target, recording every slot on it together with
+ * a snapshot of the pair it held so that the caller can validate the path once the locks are taken. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+typename CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::path_t CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::find_path(const view_t& v, size_t target) {
+  auto table = v.table;
+  auto capacity = v.capacity;
+  path_t path;
   path.reserve(kCuckooThreshold);
-  path.emplace_back(target, table[target].key);
+  path.emplace_back(target, table->get(target));
   auto cur = target;
   auto i = 0;
   do {
-    Key_t* key;
-    size_t f_hash, s_hash;
-    key = &table[cur].key;
-    if(memcmp(key, &INVALID<Key_t>, sizeof(Key_t)) == 0) break;
-    f_hash = hash_funcs[0](key, sizeof(Key_t), _seed);
-    s_hash = hash_funcs[1](key, sizeof(Key_t), _seed);
+    auto& key = table->key(cur);
+    if(KT::empty(key)) break;
 
-    auto f_idx = f_hash % capacity;
-    auto s_idx = s_hash % capacity;
+    auto f_idx = KT::hash(key, kSeed[0]) % capacity;
+    auto s_idx = KT::hash(key, kSeed[1]) % capacity;
 
     if (f_idx == cur) {
-      path.emplace_back(s_idx, table[s_idx].key);
+      path.emplace_back(s_idx, table->get(s_idx));
       cur = s_idx;
     } else if (s_idx == cur) {
-      path.emplace_back(f_idx, table[f_idx].key);
+      path.emplace_back(f_idx, table->get(f_idx));
       cur = f_idx;
     } else {  // something terribly wrong
       cout << "E: " << f_idx << " " << s_idx << " " << cur << " " << target << endl;
-      cout << *key << endl;
+      cout << key << endl;
       exit(1);
     }
     i++;
@@ -407,117 +398,60 @@ vector<pair<size_t,Key_t>> CuckooHash<Key_t>::find_path(size_t target) {
   return move(path);
 }
 
-template <typename Key_t>
-bool CuckooHash<Key_t>::execute_path(vector<pair<size_t,string>>& path, bool flag) {
-  auto i = 0;
-  auto j = (i+1)%2;
-
-  for (auto p: path) {
-	  memcpy(pushed[j].key, table[p.first].key, sizeof(Key_t));
-	  memcpy(&pushed[j].value, &table[p.first].value, sizeof(Value_t));
-	  memcpy(table[p.first].key, pushed[i].key, sizeof(Key_t));
-	  memcpy(&table[p.first].value, &pushed[i].value, sizeof(Value_t));
-	 // memcpy(&pushed[j], &table[p.first], sizeof(Pair<Key_t>));
-	  //memcpy(&table[p.first], &pushed[i], sizeof(Pair<Key_t>));
-    //pushed[j] = table[p.first];
-    //table[p.first] = pushed[i];
-    i = (i+1)%2;
-    j = (i+1)%2;
-  }
-  return true;
-}
-
-
-template <typename Key_t>
-bool CuckooHash<Key_t>::execute_path(vector<pair<size_t,Key_t>>& path) {
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::execute_path(const view_t& v, path_t& path) {
+  auto table = v.table;
   auto i = 0;
   auto j = (i+1)%2;
 
-  for (auto p: path) {
-	  memcpy(&pushed[j], &table[p.first], sizeof(Pair<Key_t>));
-	  memcpy(&table[p.first], &pushed[i], sizeof(Pair<Key_t>));
-    //pushed[j] = table[p.first];
-    //table[p.first] = pushed[i];
+  for (auto& p: path) {
+	  pushed[j] = table->get(p.first);
+	  table->set(p.first, pushed[i]);
     i = (i+1)%2;
     j = (i+1)%2;
   }
   return true;
 }
 
-template <typename Key_t>
-bool CuckooHash<Key_t>::execute_path(vector<pair<size_t,string>>& path, Key_t& key, Value_t value, bool flag) {
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::execute_path(const view_t& v, path_t& path, Key_t& key, Value_t value) {
+  auto table = v.table;
   for (int i = path.size()-1; i > 0; --i) {
-	  memcpy(table[path[i].first].key, table[path[i-1].first].key, sizeof(Key_t));
-	  memcpy(&table[path[i].first].value, &table[path[i-1].first].value,sizeof(Value_t));
-	 // memcpy(&table[path[i].first], &table[path[i-1].first], sizeof(Pair<Key_t>));
-    //table[path[i].first] = table[path[i-1].first];
+	  table->set(path[i].first, table->get(path[i-1].first));
   }
-  memcpy(table[path[0].first].key, key, sizeof(Key_t));
-  memcpy(&table[path[0].first].value, &value, sizeof(Value_t));
+  KT::copy(table->key(path[0].first), key);
+  table->value(path[0].first) = value;
   return true;
 }
 
-
-template <typename Key_t>
-bool CuckooHash<Key_t>::execute_path(vector<pair<size_t,Key_t>>& path, Key_t& key, Value_t value) {
-  for (int i = path.size()-1; i > 0; --i) {
-	  memcpy(&table[path[i].first], &table[path[i-1].first], sizeof(Pair<Key_t>));
-    //table[path[i].first] = table[path[i-1].first];
-  }
-  memcpy(&table[path[0].first].key, &key, sizeof(Key_t));
-  memcpy(&table[path[0].first].value, &value, sizeof(Value_t));
-  return true;
-}
-
-template <typename Key_t>
-bool CuckooHash<Key_t>::Update(Key_t& key, Value_t value) {
-    size_t f_hash, s_hash;
-    if constexpr(sizeof(Key_t) > 8){
-        f_hash = hash_funcs[0](key, sizeof(Key_t), _seed);
-        s_hash = hash_funcs[1](key, sizeof(Key_t), _seed);
-    }
-    else{
-        f_hash = hash_funcs[0](&key, sizeof(Key_t), _seed);
-        s_hash = hash_funcs[1](&key, sizeof(Key_t), _seed);
-    }
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::Update(Key_t& key, Value_t value) {
+    auto f_hash = KT::hash(key, kSeed[0]);
+    auto s_hash = KT::hash(key, kSeed[1]);
 
 RETRY:
-    while(resizing_lock){
-        asm("nop");
-    }
+    wait_resize();
 
-    auto f_idx = f_hash % capacity;
-    auto s_idx = s_hash % capacity;
+    auto v = load_view();
+    auto table = v->table;
+    auto f_idx = f_hash % v->capacity;
+    auto s_idx = s_hash % v->capacity;
 
     { // try first hashing
-        unique_lock<shared_mutex> lock(mutex[f_idx/locksize]);
-        if constexpr(sizeof(Key_t) > 8){
-            if(memcmp(table[f_idx].key, key, sizeof(Key_t)) == 0){
-		memcpy(&table[f_idx].value, &value, sizeof(Value_t));
-                return true;
-            }
-        }
-        else{
-            if(memcmp(&table[f_idx].key, &key, sizeof(Key_t)) == 0){
-		memcpy(&table[f_idx].value, &value, sizeof(Value_t));
-                return true;
-            }
+        unique_lock<stripe_t> lock(v->mutex[f_idx/locksize]);
+        if(v != load_view()) goto RETRY;
+        if(KT::equal(table->key(f_idx), key)){
+            table->value(f_idx) = value;
+            return true;
         }
     }
 
     { // try second hashing
-        unique_lock<shared_mutex> lock(mutex[s_idx/locksize]);
-        if constexpr(sizeof(Key_t) > 8){
-            if(memcmp(table[s_idx].key, key, sizeof(Key_t)) == 0){
-		memcpy(&table[s_idx].value, &value, sizeof(Value_t));
-                return true;
-            }
-        }
-        else{
-            if(memcmp(&table[s_idx].key, &key, sizeof(Key_t)) == 0){
-		memcpy(&table[s_idx].value, &value, sizeof(Value_t));
-                return true;
-            }
+        unique_lock<stripe_t> lock(v->mutex[s_idx/locksize]);
+        if(v != load_view()) goto RETRY;
+        if(KT::equal(table->key(s_idx), key)){
+            table->value(s_idx) = value;
+            return true;
         }
     }
                                                                            
@@ -526,173 +460,380 @@ RETRY:
 
 
 
-template <typename Key_t>
-bool CuckooHash<Key_t>::Delete(Key_t& key) {
-    size_t f_hash, s_hash;
-    if constexpr(sizeof(Key_t) > 8){
-        f_hash = hash_funcs[0](key, sizeof(Key_t), _seed);
-        s_hash = hash_funcs[1](key, sizeof(Key_t), _seed);
-    }
-    else{
-        f_hash = hash_funcs[0](&key, sizeof(Key_t), _seed);
-        s_hash = hash_funcs[1](&key, sizeof(Key_t), _seed);
-    }
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::Delete(Key_t& key) {
+    auto f_hash = KT::hash(key, kSeed[0]);
+    auto s_hash = KT::hash(key, kSeed[1]);
 
 RETRY:
-    while(resizing_lock){
-        asm("nop");
-    }
+    wait_resize();
 
-    auto f_idx = f_hash % capacity;
-    auto s_idx = s_hash % capacity;
+    auto v = load_view();
+    auto table = v->table;
+    auto f_idx = f_hash % v->capacity;
+    auto s_idx = s_hash % v->capacity;
 
     { // try first hashing
-        unique_lock<shared_mutex> lock(mutex[f_idx/locksize]);
-        if constexpr(sizeof(Key_t) > 8){
-            if(memcmp(table[f_idx].key, key, sizeof(Key_t)) == 0){
-                memcpy(table[f_idx].key, INVALID<Key_t>, sizeof(Key_t));
-                return true;
-            }
-        }
-        else{
-            if(memcmp(&table[f_idx].key, &key, sizeof(Key_t)) == 0){
-                memcpy(&table[f_idx].key, &INVALID<Key_t>, sizeof(Key_t));
-                return true;
-            }
+        unique_lock<stripe_t> lock(v->mutex[f_idx/locksize]);
+        if(v != load_view()) goto RETRY;
+        if(KT::equal(table->key(f_idx), key)){
+            KT::clear(table->key(f_idx));
+            pairs.add(-1);
+            return true;
         }
     }
 
     { // try second hashing
-        unique_lock<shared_mutex> lock(mutex[s_idx/locksize]);
-        if constexpr(sizeof(Key_t) > 8){
-            if(memcmp(table[s_idx].key, key, sizeof(Key_t)) == 0){
-                memcpy(table[s_idx].key, INVALID<Key_t>, sizeof(Key_t));
-                return true;
-            }
-        }
-        else{
-            if(memcmp(&table[s_idx].key, &key, sizeof(Key_t)) == 0){
-                memcpy(&table[s_idx].key, &INVALID<Key_t>, sizeof(Key_t));
-                return true;
-            }
+        unique_lock<stripe_t> lock(v->mutex[s_idx/locksize]);
+        if(v != load_view()) goto RETRY;
+        if(KT::equal(table->key(s_idx), key)){
+            KT::clear(table->key(s_idx));
+            pairs.add(-1);
+            return true;
         }
     }
                                                                            
   return false;
 }
 
-template <typename Key_t>
-char* CuckooHash<Key_t>::Get(Key_t& key) {
-  if (resizing_lock) {
-    for (unsigned i = 0; i < kNumHash; ++i) {
-	    int idx;
-	    if constexpr(sizeof(Key_t) > 8)
-		    idx = hash_funcs[i](key, sizeof(Key_t), _seed) % old_cap;
-	    else
-		    idx = hash_funcs[i](&key, sizeof(Key_t), _seed) % old_cap;
-      std::shared_lock<std::shared_mutex> lock(mutex[idx/locksize]);
-      if constexpr(sizeof(Key_t) > 8){
-	      if(memcmp(old_tab[idx].key, key, sizeof(Key_t)) == 0)
-		      return (char*)old_tab[idx].value;
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::Get(Key_t& key, Value_t& value) {
+  auto f_hash = KT::hash(key, kSeed[0]);
+  auto s_hash = KT::hash(key, kSeed[1]);
+  bool found;
+  backoff b;
+  while (!read(key, f_hash, s_hash, value, found)) b.pause();
+  return found;
+}
+
+/* One lock-free lookup attempt, false if it has to be retried; found tells whether value holds the value of
+ * key then. The versions of both candidate stripes are
+ * taken before and checked after the slots are read, so a displacement that moves key from one slot to the
+ * other in between is noticed as well. A resize leaves the old table alone until it publishes the new view,
+ * so a lookup may go on in the old one meanwhile and only has to retry if the view has been replaced. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::read(Key_t& key, size_t f_hash, size_t s_hash, Value_t& value, bool& found) {
+  auto v = __atomic_load_n(&view, __ATOMIC_ACQUIRE);
+  size_t idx[2] = {f_hash % v->capacity, s_hash % v->capacity};
+  uint64_t version[2];
+  for (size_t i = 0; i < kNumHash; i++) {
+    version[i] = __atomic_load_n(&v->mutex[idx[i]/locksize].version, __ATOMIC_ACQUIRE);
+    if (version[i] & 1) return false;
+  }
+  found = false;
+  for (size_t i = 0; i < kNumHash; i++) {
+    if (KT::equal(v->table->key(idx[i]), key)) {
+      value = VT::load(v->table->value(idx[i]));
+      found = true;
+      break;
+    }
+  }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  for (size_t i = 0; i < kNumHash; i++) {
+    if (__atomic_load_n(&v->mutex[idx[i]/locksize].version, __ATOMIC_RELAXED) != version[i]) return false;
+  }
+  return __atomic_load_n(&view, __ATOMIC_ACQUIRE) == v;
+}
+
+/* Runs fn on the value slot of key (see util/value_traits.h): each candidate slot is checked under the
+ * value_lock of its stripe, in the view the lookup started from, or again in the new one after a resize. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+template <typename F>
+bool CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::apply(Key_t& key, F&& fn) {
+  auto f_hash = KT::hash(key, kSeed[0]);
+  auto s_hash = KT::hash(key, kSeed[1]);
+
+RETRY:
+  wait_resize();
+  auto v = load_view();
+  for (auto hash: {f_hash, s_hash}) {
+    auto idx = hash % v->capacity;
+    value_lock<Value_t, stripe_t> lock(v->mutex[idx/locksize]);
+    if (v != load_view()) goto RETRY;
+    if (KT::equal(v->table->key(idx), key))
+      return fn(&v->table->value(idx));
+  }
+  return false;
+}
+
+/* Applies op to every pair of the batch, grouped by the stripe of the first hash slot.
+ * op(table, i, slot) is tried on both candidate slots as long as they are covered by the lock held,
+ * pairs it could not be applied to go through fallback(i) one by one. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+template <typename Op, typename Fallback>
+size_t CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::batch(Pair<Key_t, Value_t>* kv, size_t num, Op&& op, Fallback&& fallback) {
+  vector<size_t> f_hash(num), s_hash(num), stripe(num);
+  hash_batch<Key_t, Hasher>(kv, num, kSeed[0], f_hash.data());
+  hash_batch<Key_t, Hasher>(kv, num, kSeed[1], s_hash.data());
+
+  wait_resize();
+  auto v = load_view();
+  auto _capacity = v->capacity;
+  for (size_t i = 0; i < num; i++)
+    stripe[i] = (f_hash[i] % _capacity) / locksize;
+
+  size_t cnt = 0;
+  bool stale = false;
+  vector<uint32_t> leftover;
+  for_each_group(stripe.data(), num, [&](size_t s, const uint32_t* idx, size_t n){
+      if (!stale) {
+        unique_lock<stripe_t> lock(v->mutex[s]);
+        if (v == load_view()) {
+          for (size_t j = 0; j < n; j++) {
+            auto i = idx[j];
+            auto f_idx = f_hash[i] % _capacity;
+            auto s_idx = s_hash[i] % _capacity;
+            if (op(v->table, i, f_idx) || (s_idx/locksize == s && op(v->table, i, s_idx)))
+              cnt++;
+            else
+              leftover.push_back(i);
+          }
+          return;
+        }
+        /* the table has been resized under us, leave the rest to the per-key path */
+        stale = true;
       }
-      else
-	      if(memcmp(&old_tab[idx].key, &key, sizeof(Key_t)) == 0)
-		      return (char*)old_tab[idx].value;
+      leftover.insert(leftover.end(), idx, idx+n);
+  });
+
+  for (auto i: leftover)
+    cnt += fallback(i);
+  return cnt;
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+void CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::InsertBatch(Pair<Key_t, Value_t>* kv, size_t num) {
+  size_t placed = 0;
+  batch(kv, num, [&](table_t* table, size_t i, size_t slot){
+      if(KT::empty(table->key(slot))){
+        KT::copy(table->key(slot), kv[i].key);
+        table->value(slot) = kv[i].value;
+        placed++;
+        return true;
       }
+      return false;
+  }, [&](size_t i){
+      Insert(kv[i].key, kv[i].value);
+      return true;
+  });
+  pairs.add(placed);
+}
 
-  } else {
-    for (int i = 0; i < kNumHash; i++) {
-	    int idx;
-	    if constexpr(sizeof(Key_t) > 8)
-		    idx = hash_funcs[i](key, sizeof(Key_t), _seed) % capacity;
-	    else
-		    idx = hash_funcs[i](&key, sizeof(Key_t), _seed) % capacity;
-      std::shared_lock<std::shared_mutex> lock(mutex[idx/locksize]);
-      if constexpr(sizeof(Key_t) > 8){
-	      if(memcmp(table[idx].key, key, sizeof(Key_t)) == 0)
-		      return (char*)table[idx].value;
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+void CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::reserve(size_t num, size_t num_threads) {
+  size_t live = Size();
+  if (load_view()->capacity*load_factor < live + num)
+    resize((live + num) / load_factor + 1, num_threads);
+}
+
+/* Partitions are ranges of first-choice slots: a pair takes its first slot, or its second one if that is
+ * in the range of the same thread, and is otherwise left to Insert, which displaces as usual. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+void CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::BulkLoad(Pair<Key_t, Value_t>* kv, size_t num, size_t num_threads) {
+  reserve(num, num_threads);
+  auto table = load_view()->table;
+  auto capacity = load_view()->capacity;
+
+  size_t nparts = (capacity + kBulkPartition - 1) / kBulkPartition;
+  vector<uint32_t> order;
+  vector<size_t> bounds;
+  parallel_partition(num, nparts, num_threads, [&](size_t from, size_t n, uint32_t* id){
+      size_t f_hash[kHashBatch];
+      for (size_t i = 0; i < n; i += kHashBatch) {
+        auto m = std::min(kHashBatch, n - i);
+        hash_batch<Key_t, Hasher>(&kv[from+i], m, kSeed[0], f_hash);
+        for (size_t j = 0; j < m; j++)
+          id[i+j] = f_hash[j] % capacity / kBulkPartition;
       }
-      else
-	      if(memcmp(&table[idx].key, &key, sizeof(Key_t)) == 0)
-		      return (char*)table[idx].value;
+  }, order, bounds);
+
+  vector<vector<uint32_t>> overflow(num_threads);
+  parallel_run(num_threads, [&](size_t tid){
+      size_t first = nparts*tid/num_threads, last = nparts*(tid+1)/num_threads;
+      size_t begin = first*kBulkPartition, end = std::min(last*kBulkPartition, capacity);
+      for (size_t j = bounds[first]; j < bounds[last]; j++) {
+        auto i = order[j];
+        auto idx = KT::hash(kv[i].key, kSeed[0]) % capacity;
+        if (!KT::empty(table->key(idx))) {
+          idx = KT::hash(kv[i].key, kSeed[1]) % capacity;
+          if (idx < begin || idx >= end || !KT::empty(table->key(idx))) {
+            overflow[tid].push_back(i);
+            continue;
+          }
+        }
+        KT::copy(table->key(idx), kv[i].key);
+        table->value(idx) = kv[i].value;
       }
-    }
-    return (char*)NONE;
+  });
+  size_t placed = num;
+  for (auto& o: overflow)
+    placed -= o.size();
+  pairs.add(placed);
+
+  parallel_run(num_threads, [&](size_t tid){
+      for (auto i: overflow[tid])
+        Insert(kv[i].key, kv[i].value);
+  });
 }
 
-template <typename Key_t>
-double CuckooHash<Key_t>::Utilization(void) {
-  size_t n = 0;
-  for (int i = 0; i < capacity; i++) {
-	  if constexpr(sizeof(Key_t) > 8){
-		  if(memcmp(table[i].key, INVALID<Key_t>, sizeof(Key_t)) != 0)
-			  n++;
-	  }
-	  else{
-		  if(memcmp(&table[i].key, &INVALID<Key_t>, sizeof(Key_t)) != 0)
-			  n++;
-	  }
-  }
-  return ((double)n)/((double)capacity)*100;
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+size_t CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::UpdateBatch(Pair<Key_t, Value_t>* kv, size_t num) {
+  return batch(kv, num, [&](table_t* table, size_t i, size_t slot){
+      if(KT::equal(table->key(slot), kv[i].key)){
+        table->value(slot) = kv[i].value;
+        return true;
+      }
+      return false;
+  }, [&](size_t i){
+      return Update(kv[i].key, kv[i].value);
+  });
 }
 
-template <typename Key_t>
-bool CuckooHash<Key_t>::resize(void) {
-  old_cap = capacity;
-  old_tab = table;
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+size_t CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::DeleteBatch(Pair<Key_t, Value_t>* kv, size_t num) {
+  return batch(kv, num, [&](table_t* table, size_t i, size_t slot){
+      if(KT::equal(table->key(slot), kv[i].key)){
+        KT::clear(table->key(slot));
+        pairs.add(-1);
+        return true;
+      }
+      return false;
+  }, [&](size_t i){
+      return Delete(kv[i].key);
+  });
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+task<bool> CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::GetCoro(Key_t& key, Value_t& value) {
+  auto f_hash = KT::hash(key, kSeed[0]);
+  auto s_hash = KT::hash(key, kSeed[1]);
+  auto v = __atomic_load_n(&view, __ATOMIC_ACQUIRE);
+  // both candidate slots are independent, so fetch them together and suspend once
+  __builtin_prefetch(v->table->keys(s_hash % v->capacity));
+  co_await prefetch(v->table->keys(f_hash % v->capacity), table_t::kProbeBytes);
+
+  bool found;
+  backoff b;
+  while (!read(key, f_hash, s_hash, value, found)) b.pause();
+  co_return found;
+}
 
-  std::unique_lock<std::shared_mutex> *lock[nlocks];
+/* A displacement path holds the locks of all its stripes before it releases resizing_lock,
+ * so once resizing_lock is seen free every stripe is visited either before or after a move. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+template <typename F>
+void CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::ForEach(F&& fn, size_t num_threads) {
+  __atomic_fetch_add(&scanners, 1, __ATOMIC_SEQ_CST);
+  wait_resize();
+
+  auto v = load_view();
+  auto _capacity = v->capacity;
+  auto _table = v->table;
+  size_t nstripes = (_capacity + locksize - 1) / locksize;
+  parallel_run(num_threads, [&](size_t tid){
+      vector<Pair<Key_t, Value_t>> buf;
+      buf.reserve(locksize);
+      for (size_t s = nstripes*tid/num_threads; s < nstripes*(tid+1)/num_threads; s++) {
+        buf.clear();
+        {
+          std::shared_lock<stripe_t> lock(v->mutex[s]);
+          for (size_t i = s*locksize; i < std::min((s+1)*locksize, _capacity); i++) {
+            if (!KT::empty(_table->key(i)))
+              buf.push_back(_table->get(i));
+          }
+        }
+        if (!buf.empty())
+          fn(buf.data(), buf.size());
+      }
+  });
+
+  __atomic_fetch_sub(&scanners, 1, __ATOMIC_SEQ_CST);
+}
+
+/* The old table is rehashed in chunks by the resizing thread, num_threads-1 workers and every thread that
+ * waits for the resize: a pair goes to one of its two slots, under the stripe lock of the new table, if it
+ * is free. The pairs left over need displacements, which this thread does alone once the chunks are done. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool CuckooHash<Key_t, Value_t, Hasher, Layout, Lock>::resize(size_t _capacity, size_t num_threads) {
+  auto old = load_view();
+
+  /* the old table does not change while the locks are held, so lookups go on in it: its versions stay even */
+  std::unique_lock<Lock> *lock[nlocks];
   for(int i=0;i<nlocks;i++){
-    lock[i] = new std::unique_lock<std::shared_mutex>(mutex[i]);
+    lock[i] = new std::unique_lock<Lock>(old->mutex[i].mutex);
   }
-  std::shared_mutex* old_mutex = mutex;
 
   int prev_nlocks = nlocks;
 
+  /* the new table is filled in next and published with the view once it is complete */
+  view_t next{nullptr, 0, nullptr};
   bool success = true;
   size_t num_grows = 0;
 
   do {
     success = true;
-    if (table != old_tab) delete [] table;
-    capacity = capacity * kResizingFactor;
-    table = new Pair<Key_t>[capacity];
-    if (table == nullptr) {
+    next.capacity = num_grows ? next.capacity * kResizingFactor : _capacity;
+    next.table = new table_t(next.capacity);
+    if (next.table == nullptr) {
       cerr << "error: memory allocation failed." << endl;
       exit(1);
     }
 
-    for (unsigned i = 0; i < old_cap; ++i) {
-	    if constexpr(sizeof(Key_t) > 8){
-		    if(memcmp(old_tab[i].key, INVALID<Key_t>, sizeof(Key_t)) != 0){
-			    if(!insert4resize(old_tab[i].key, old_tab[i].value)){
-				    success = false;
-				    break;
+    next.mutex = new stripe_t[next.capacity/locksize+1];
+    vector<size_t> conflicts;
+    std::mutex conflicts_mutex;
+    rehash.run((old->capacity + kRehashChunk - 1) / kRehashChunk, num_threads, [&](size_t chunk){
+	    size_t f_hash[kHashBatch], s_hash[kHashBatch];
+	    vector<size_t> local;
+	    size_t end = std::min((chunk+1)*kRehashChunk, old->capacity);
+	    for (size_t from = chunk*kRehashChunk; from < end; from += kHashBatch) {
+		    size_t n = std::min(kHashBatch, end - from);
+		    hash_batch<Key_t, Hasher>(old->table->keys(from), table_t::kStride, n, kSeed[0], f_hash);
+		    hash_batch<Key_t, Hasher>(old->table->keys(from), table_t::kStride, n, kSeed[1], s_hash);
+		    for (size_t j = 0; j < n; ++j) {
+			    auto i = from + j;
+			    if (KT::empty(old->table->key(i)))
+				    continue;
+			    bool placed = false;
+			    for (auto idx: {f_hash[j] % next.capacity, s_hash[j] % next.capacity}) {
+				    std::unique_lock<Lock> stripe(next.mutex[idx/locksize].mutex);
+				    if (KT::empty(next.table->key(idx))) {
+					    next.table->set(idx, old->table->get(i));
+					    placed = true;
+					    break;
+				    }
 			    }
+			    if (!placed)
+				    local.push_back(i);
 		    }
 	    }
-	    else{
-		    if(memcmp(&old_tab[i].key, &INVALID<Key_t>, sizeof(Key_t)) != 0){
-			    if(!insert4resize(old_tab[i].key, old_tab[i].value)){
-				    success = false;
-				    break;
-			    }
-		    }
+	    if (!local.empty()) {
+		    std::lock_guard<std::mutex> guard(conflicts_mutex);
+		    conflicts.insert(conflicts.end(), local.begin(), local.end());
+	    }
+    });
+
+    for (auto i: conflicts) {
+	    auto& key = old->table->key(i);
+	    if (!insert4resize(next, key, old->table->value(i), KT::hash(key, kSeed[0]), KT::hash(key, kSeed[1]))) {
+		    success = false;
+		    delete next.table;
+		    delete[] next.mutex;
+		    break;
 	    }
     }
     ++num_grows;
   } while (!success && num_grows < kMaxGrows);
 
+  if (!success)
+    exit(1);
+
+  nlocks = next.capacity/locksize+1;
+  retired.push_back(old);
+  __atomic_store_n(&view, new view_t(next), __ATOMIC_RELEASE);
   for (int i = 0; i < prev_nlocks; ++i) {
     delete lock[i];
   }
-
-  if (success) {
-    nlocks = capacity/locksize+1;
-    mutex = new std::shared_mutex[nlocks];
-    delete old_mutex;
-  } else {
-    exit(1);
-  }
   return success;
 }
+
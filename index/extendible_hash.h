@@ -11,47 +11,58 @@
 #include <shared_mutex>
 #include "util/pair.h"
 #include "util/hash.h"
+#include "util/key_traits.h"
+#include "util/hash_batch.h"
+#include "util/batch.h"
+#include "util/parallel.h"
+#include "util/counter.h"
+#include "util/rwlock.h"
+#include "util/wait.h"
 #include "index/interface.h"
 
 #define f_seed 0xc70697UL
-#define s_seed 0xc70697UL
+/* S_HASH probes a second range, hashed with the same policy under another seed */
+#define s_seed 0x9ae16a3bUL
 
 const size_t kMask = 256-1;
 const size_t kShift = 8;
 const size_t kNumPairPerCacheLine = 4;
 const size_t kNumCacheLine = 256;
+/* default planned load of Reserve and BulkLoad; splits leave segments between half and full */
+const float kDefaultLoadFactor = 0.75;
 
 using namespace std;
 
-template <typename Key_t>
+template <typename Key_t, typename Value_t = default_value, typename Hasher = default_hash, typename Lock = default_lock>
 struct Segment{
     static const size_t kNumSlot = 1024;
+    using KT = KeyTraits<Key_t, Hasher>;
 
     Segment(void): local_depth(0){ }
     Segment(size_t depth): local_depth(depth) { }
     ~Segment(void) { }
     
     bool Insert4split(Key_t&, Value_t, size_t);
-    Segment<Key_t>** Split(void);
+    Segment<Key_t, Value_t, Hasher, Lock>** Split(void);
 
-    Pair<Key_t> _[kNumSlot];
+    Pair<Key_t, Value_t> _[kNumSlot];
     size_t local_depth;
-    shared_mutex mutex;
+    Lock mutex;
 };
 
-template <typename Key_t>
+template <typename Key_t, typename Value_t = default_value, typename Hasher = default_hash, typename Lock = default_lock>
 struct Directory{
     static const size_t kDefaultDepth = 10;
-    Segment<Key_t>** _;
+    Segment<Key_t, Value_t, Hasher, Lock>** _;
     int64_t sema;
     size_t capacity;
     size_t depth;
 
     Directory(void): depth(kDefaultDepth), capacity(pow(2, kDefaultDepth)), sema(0){
-	_ = new Segment<Key_t>*[capacity];
+	_ = new Segment<Key_t, Value_t, Hasher, Lock>*[capacity];
     }
     Directory(size_t _depth): depth(_depth), capacity(pow(2, _depth)), sema(0){
-	_ = new Segment<Key_t>*[capacity];
+	_ = new Segment<Key_t, Value_t, Hasher, Lock>*[capacity];
     }
     ~Directory(void) { }
 
@@ -63,9 +74,9 @@ struct Directory{
 	}while(!CAS(&sema, &val, -1));
 
 	int64_t wait = 0 - val - 1;
-	while(val && sema != wait){
-	    asm("nop");
-	}
+	backoff b;
+	while(val && __atomic_load_n(&sema, __ATOMIC_ACQUIRE) != wait)
+	    b.pause();
 	return true;
     }
 
@@ -86,78 +97,158 @@ struct Directory{
 
 };
 
-template <typename Key_t>
-class ExtendibleHash : public Hash<Key_t> {
+template <typename Key_t, typename Value_t = default_value, typename Hasher = default_hash, typename Lock = default_lock>
+class ExtendibleHash final : public Hash<Key_t, Value_t> {
+    using KT = KeyTraits<Key_t, Hasher>;
+    using VT = ValueTraits<Value_t>;
     private:
-	Directory<Key_t>* dir;
+	Directory<Key_t, Value_t, Hasher, Lock>* dir;
+	float load_factor = kDefaultLoadFactor;
+	sharded_counter pairs;
+	size_t segments;
+	wait_queue dir_wait;  // threads waiting for a directory doubling
     public:
-	ExtendibleHash(void): dir(new Directory<Key_t>(0)){
+	ExtendibleHash(void): dir(new Directory<Key_t, Value_t, Hasher, Lock>(0)), segments(1){
 	    for(int i=0; i<dir->capacity; i++)
-		dir->_[i] = new Segment<Key_t>(0);
+		dir->_[i] = new Segment<Key_t, Value_t, Hasher, Lock>(0);
 	}
-	ExtendibleHash(size_t initCap): dir(new Directory<Key_t>(static_cast<size_t>(log2(initCap)))){
+	ExtendibleHash(size_t initCap): dir(new Directory<Key_t, Value_t, Hasher, Lock>(static_cast<size_t>(log2(initCap)))){
 	    for(int i=0; i<dir->capacity; i++)
-		dir->_[i] = new Segment<Key_t>(static_cast<size_t>(log2(initCap)));
+		dir->_[i] = new Segment<Key_t, Value_t, Hasher, Lock>(static_cast<size_t>(log2(initCap)));
+	    segments = dir->capacity;
+	}
+	/* directory deep enough for expected pairs at load_factor, which Reserve and BulkLoad plan with as well */
+	ExtendibleHash(size_t expected, float _load_factor): ExtendibleHash((size_t)1 << planned(expected, _load_factor)){
+	    load_factor = _load_factor;
 	}
 	~ExtendibleHash(void){ }
-	void Insert(Key_t&, Value_t);
+	void Insert(Key_t& key, Value_t value){
+	    put<false>(key, value, false);
+	    pairs.add(1);
+	}
+	bool Upsert(Key_t& key, Value_t value){
+	    if(!put<true>(key, value, true))
+		return false;
+	    pairs.add(1);
+	    return true;
+	}
+	bool GetOrInsert(Key_t& key, Value_t& value){
+	    if(!put<true>(key, value, false))
+		return false;
+	    pairs.add(1);
+	    return true;
+	}
 	bool Update(Key_t&, Value_t);
+	bool FetchAdd(Key_t& key, Value_t delta, Value_t* prev = nullptr){
+	    return apply(key, [&](Value_t* v){
+		    auto old = VT::fetch_add(*v, delta);
+		    if(prev) *prev = old;
+		    return true;
+		});
+	}
+	bool CompareExchange(Key_t& key, Value_t& expected, Value_t desired){
+	    return apply(key, [&](Value_t* v){
+		    return VT::compare_exchange(*v, expected, desired);
+		});
+	}
+	template <typename F>
+	bool Modify(Key_t& key, F&& fn){
+	    return apply(key, [&](Value_t* v){
+		    auto old = VT::load(*v);
+		    while(!VT::compare_exchange(*v, old, fn(old)));
+		    return true;
+		});
+	}
+	bool Modify(Key_t& key, const function<Value_t(Value_t)>& fn){
+	    return Modify<const function<Value_t(Value_t)>&>(key, fn);
+	}
 	bool Delete(Key_t&);
-	char* Get(Key_t&);
-	double Utilization(void);
-	size_t Capacity(void);
+	bool Get(Key_t&, Value_t&);
+	void InsertBatch(Pair<Key_t, Value_t>*, size_t);
+	size_t UpdateBatch(Pair<Key_t, Value_t>*, size_t);
+	size_t DeleteBatch(Pair<Key_t, Value_t>*, size_t);
+	void Reserve(size_t num){
+	    reserve(num, 1);
+	}
+	void BulkLoad(Pair<Key_t, Value_t>* kv, size_t num, size_t num_threads = 1){
+	    reserve(num, num_threads);
+	    fill(kv, num, num_threads);
+	}
+	task<bool> GetCoro(Key_t&, Value_t&);
+	template <typename F>
+	void ForEach(F&&, size_t num_threads = 1);
+	void ForEach(const function<void(const Pair<Key_t, Value_t>*, size_t)>& fn, size_t num_threads = 1){
+	    ForEach<const function<void(const Pair<Key_t, Value_t>*, size_t)>&>(fn, num_threads);
+	}
+	size_t Size(void){
+	    return pairs.sum();
+	}
+	double Utilization(void){
+	    return ((double)Size()) / ((double)Capacity())*100.0;
+	}
+	size_t Capacity(void){
+	    return __atomic_load_n(&segments, __ATOMIC_RELAXED) * Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	}
 	void FindAnyway(Key_t& key) { }
-	
+
+    private:
+	template <typename F>
+	bool apply(Key_t&, F&&);
+	template <bool kUnique>
+	bool put(Key_t&, Value_t&, bool);
+	template <typename Op, typename Fallback>
+	size_t batch(Pair<Key_t, Value_t>*, size_t, Op&&, Fallback&&);
+	size_t probe_start(Key_t&, size_t, int);
+	/* waits while the directory is being doubled (the old one stays suspended, the new one is not) */
+	void wait_dir(void){
+	    dir_wait.wait_until([this]{
+		    auto d = __atomic_load_n(&dir, __ATOMIC_ACQUIRE);
+		    return __atomic_load_n(&d->sema, __ATOMIC_ACQUIRE) >= 0;
+		});
+	}
+	void reserve(size_t, size_t);
+	void fill(Pair<Key_t, Value_t>*, size_t, size_t);
+	static size_t planned(size_t num, float _load_factor){
+	    size_t depth = 0;
+	    while(((size_t)1 << depth) * Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot * _load_factor < num)
+		depth++;
+	    return depth;
+	}
 };
 
-template <typename Key_t>
-bool Segment<Key_t>::Insert4split(Key_t& key, Value_t value, size_t loc) {
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+bool Segment<Key_t, Value_t, Hasher, Lock>::Insert4split(Key_t& key, Value_t value, size_t loc) {
     for (unsigned i = 0; i < kNumPairPerCacheLine * kNumCacheLine; ++i) {
 	auto slot = (loc+i) % kNumSlot;
-	if constexpr(sizeof(Key_t) > 8){
-	    if(memcmp(_[slot].key, INVALID<Key_t>, sizeof(Key_t)) == 0){
-		memcpy(_[slot].key, key, sizeof(Key_t));
-		memcpy(&_[slot].value, &value, sizeof(Value_t));
-		return true;
-	    }
-	}
-	else{
-	    if(memcmp(&_[slot].key, &INVALID<Key_t>, sizeof(Key_t)) == 0){
-		memcpy(&_[slot].key, &key, sizeof(Key_t));
-		memcpy(&_[slot].value, &value, sizeof(Value_t));
-		return true;
-	    }
+	if(KT::empty(_[slot].key)){
+	    KT::copy(_[slot].key, key);
+	    _[slot].value = value;
+	    return true;
 	}
     }
     return false;
 }
 
-template <typename Key_t>
-Segment<Key_t>** Segment<Key_t>::Split(void){
-    Segment<Key_t>** split = new Segment<Key_t>*[2];
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+Segment<Key_t, Value_t, Hasher, Lock>** Segment<Key_t, Value_t, Hasher, Lock>::Split(void){
+    Segment<Key_t, Value_t, Hasher, Lock>** split = new Segment<Key_t, Value_t, Hasher, Lock>*[2];
 #ifdef INPLACE
     split[0] = this;
 #else
-    split[0] = new Segment<Key_t>(local_depth+1);
+    split[0] = new Segment<Key_t, Value_t, Hasher, Lock>(local_depth+1);
 #endif
-    split[1] = new Segment<Key_t>(local_depth+1);
+    split[1] = new Segment<Key_t, Value_t, Hasher, Lock>(local_depth+1);
 
     auto pattern = ((size_t)1 << (sizeof(size_t)*8 - local_depth - 1));
+    size_t hashes[kNumSlot];
+    hash_batch<Key_t, Hasher>(_, kNumSlot, f_seed, hashes);
     for (unsigned i = 0; i < kNumSlot; ++i) {
-	size_t f_hash;
-	if constexpr(sizeof(Key_t) > 8)
-	    f_hash = hash_funcs[0](_[i].key, sizeof(Key_t), f_seed);
-	else
-	    f_hash = hash_funcs[0](&_[i].key, sizeof(Key_t), f_seed);
+	size_t f_hash = hashes[i];
 
 	if(f_hash & pattern){
 	    if(!split[1]->Insert4split(_[i].key, _[i].value, (f_hash & kMask)*kNumPairPerCacheLine)){
 #ifdef S_HASH
-		size_t s_hash;
-		if constexpr(sizeof(Key_t) > 8)
-		    s_hash = hash_funcs[2](_[i].key, sizeof(Key_t), s_seed);
-		else
-		    s_hash = hash_funcs[2](&_[i].key, sizeof(Key_t), s_seed);
+		size_t s_hash = KT::hash(_[i].key, s_seed);
 		if(!split[1]->Insert4split(_[i].key, _[i].value, (s_hash & kMask)*kNumPairPerCacheLine)){
 		    cerr << "[" << __func__ << "]: something wrong -- need to adjust probing distance" << endl;
 		}
@@ -170,11 +261,7 @@ Segment<Key_t>** Segment<Key_t>::Split(void){
 	else{
 	    if(!split[0]->Insert4split(_[i].key, _[i].value, (f_hash & kMask)*kNumPairPerCacheLine)){
 #ifdef S_HASH
-		size_t s_hash;
-		if constexpr(sizeof(Key_t) > 8)
-		    s_hash = hash_funcs[2](_[i].key, sizeof(Key_t), s_seed);
-		else
-		    s_hash = hash_funcs[2](&_[i].key, sizeof(Key_t), s_seed);
+		size_t s_hash = KT::hash(_[i].key, s_seed);
 		if(!split[0]->Insert4split(_[i].key, _[i].value, (s_hash & kMask)*kNumPairPerCacheLine)){
 		    cerr << "[" << __func__ << "]: something wrong -- need to adjust probing distance" << endl;
 		}
@@ -190,92 +277,101 @@ Segment<Key_t>** Segment<Key_t>::Split(void){
     return split;
 }
 
-template <typename Key_t>
-void ExtendibleHash<Key_t>::Insert(Key_t& key, Value_t value) {
-    size_t f_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	f_hash = hash_funcs[0](key, sizeof(Key_t), f_seed);
-    else
-	f_hash = hash_funcs[0](&key, sizeof(Key_t), f_seed);
+/* Insert (kUnique unset) takes the first free slot. Upsert/GetOrInsert (kUnique set) look for key in
+ * the whole probing range under the same segment lock, remembering the first free slot on the way;
+ * they return false if key was there, overwriting its value if assign is set and copying it to value if not. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+template <bool kUnique>
+bool ExtendibleHash<Key_t, Value_t, Hasher, Lock>::put(Key_t& key, Value_t& value, bool assign) {
+    size_t f_hash = KT::hash(key, f_seed);
     auto f_idx = (f_hash & kMask) * kNumPairPerCacheLine;
 
+    backoff b;
 RETRY:
     auto x = (f_hash >> (8*sizeof(f_hash) - dir->depth));
     auto target = dir->_[x];
 
     if(!target){
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     /* acquire segment exclusive lock */
     if(!target->mutex.try_lock()){
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     auto target_check = (f_hash >> (8*sizeof(f_hash) - dir->depth));
     if(target != dir->_[target_check]){
 	target->mutex.unlock();
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     auto target_local_depth = target->local_depth;
     auto pattern = (f_hash >> (8*sizeof(f_hash) - target->local_depth));
-    for(unsigned i=0; i<kNumPairPerCacheLine * kNumCacheLine; ++i){
-	auto loc = (f_idx + i) % Segment<Key_t>::kNumSlot;
-	if constexpr(sizeof(Key_t) > 8){
-	    if((((hash_funcs[0](target->_[loc].key, sizeof(Key_t), f_seed) >> (8*sizeof(f_hash)-target_local_depth)) != pattern) ||
-			(memcmp(target->_[loc].key, INVALID<Key_t>, sizeof(Key_t)) == 0))){
-		memcpy(target->_[loc].key, key, sizeof(Key_t));
-		memcpy(&target->_[loc].value, &value, sizeof(Value_t));
-		target->mutex.unlock();
-		return;
+    /* a slot is free when it is empty or holds a key left behind by a split */
+    auto free_slot = [&](size_t loc){
+	return (((KT::hash(target->_[loc].key, f_seed) >> (8*sizeof(f_hash)-target_local_depth)) != pattern) ||
+		(KT::empty(target->_[loc].key)));
+    };
+    if constexpr(kUnique){
+#ifdef S_HASH
+	const int num_probe = 2;
+#else
+	const int num_probe = 1;
+#endif
+	size_t free = Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	for(int p=0; p<num_probe; p++){
+	    auto start = probe_start(key, f_hash, p);
+	    for(unsigned i=0; i<kNumPairPerCacheLine * kNumCacheLine; ++i){
+		auto loc = (start + i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+		if(KT::equal(target->_[loc].key, key)){
+		    if(assign)
+			target->_[loc].value = value;
+		    else
+			value = target->_[loc].value;
+		    target->mutex.unlock();
+		    return false;
+		}
+		if(free == Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot && free_slot(loc))
+		    free = loc;
 	    }
 	}
-	else{
-	    if((((hash_funcs[0](&target->_[loc].key, sizeof(Key_t), f_seed) >> (8*sizeof(f_hash)-target_local_depth)) != pattern) ||
-			(memcmp(&target->_[loc].key, &INVALID<Key_t>, sizeof(Key_t)) == 0))){
-		memcpy(&target->_[loc].key, &key, sizeof(Key_t));
-		memcpy(&target->_[loc].value, &value, sizeof(Value_t));
-		target->mutex.unlock();
-		return;
-	    }
+	if(free != Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot){
+	    KT::copy(target->_[free].key, key);
+	    target->_[free].value = value;
+	    target->mutex.unlock();
+	    return true;
 	}
-
     }
-
-#ifdef S_HASH
-    size_t s_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	s_hash = hash_funcs[2](key, sizeof(Key_t), s_seed);
-    else
-	s_hash = hash_funcs[2](&key, sizeof(Key_t), s_seed);
-    auto s_idx = (s_hash & kMask) * kNumPairPerCacheLine;
-
-    for(unsigned i=0; i<kNumPairPerCacheLine * kNumCacheLine; ++i){
-	auto loc = (s_idx + i) % Segment<Key_t>::kNumSlot;
-	if constexpr(sizeof(Key_t) > 8){
-	    if((((hash_funcs[0](target->_[loc].key, sizeof(Key_t), f_seed) >> (8*sizeof(f_hash)-target_local_depth)) != pattern) ||
-			(memcmp(target->_[loc].key, INVALID<Key_t>, sizeof(Key_t)) == 0))){
-		memcpy(target->_[loc].key, key, sizeof(Key_t));
-		memcpy(&target->_[loc].value, &value, sizeof(Value_t));
+    else{
+	for(unsigned i=0; i<kNumPairPerCacheLine * kNumCacheLine; ++i){
+	    auto loc = (f_idx + i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	    if(free_slot(loc)){
+		KT::copy(target->_[loc].key, key);
+		target->_[loc].value = value;
 		target->mutex.unlock();
-		return;
+		return true;
 	    }
 	}
-	else{
-	    if((((hash_funcs[0](&target->_[loc].key, sizeof(Key_t), f_seed) >> (8*sizeof(f_hash)-target_local_depth)) != pattern) ||
-			(memcmp(&target->_[loc].key, &INVALID<Key_t>, sizeof(Key_t)) == 0))){
-		memcpy(&target->_[loc].key, &key, sizeof(Key_t));
-		memcpy(&target->_[loc].value, &value, sizeof(Value_t));
+
+#ifdef S_HASH
+	size_t s_hash = KT::hash(key, s_seed);
+	auto s_idx = (s_hash & kMask) * kNumPairPerCacheLine;
+
+	for(unsigned i=0; i<kNumPairPerCacheLine * kNumCacheLine; ++i){
+	    auto loc = (s_idx + i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	    if(free_slot(loc)){
+		KT::copy(target->_[loc].key, key);
+		target->_[loc].value = value;
 		target->mutex.unlock();
-		return;
+		return true;
 	    }
 	}
-    }
 #endif
+    }
 
     // COLLISION!!
     /* need to split segment but release the exclusive lock first to avoid deadlock */
@@ -284,20 +380,21 @@ RETRY:
 #ifdef BREAKDOWN
     clock_gettime(CLOCK_MONOTONIC, &t_start);
 #endif
-    Segment<Key_t>** s = target->Split();
+    Segment<Key_t, Value_t, Hasher, Lock>** s = target->Split();
+    __atomic_fetch_add(&segments, 1, __ATOMIC_RELAXED);
 
 DIR_RETRY:
     /* need to double the directory */
     if(target_local_depth == dir->depth){
 	if(!dir->suspend()){
-	    std::this_thread::yield();
+	    wait_dir();
 	    goto DIR_RETRY;
 	}
 
 	x = (f_hash >> (8*sizeof(f_hash) - dir->depth));
 	auto dir_old = dir;
 	auto d = dir->_;
-	auto _dir = new Directory<Key_t>(dir->depth+1);
+	auto _dir = new Directory<Key_t, Value_t, Hasher, Lock>(dir->depth+1);
 	for(unsigned i = 0; i < dir->capacity; ++i){
 	    if (i == x){
 		_dir->_[2*i] = s[0];
@@ -309,15 +406,14 @@ DIR_RETRY:
 	    }
 	}
 	dir = _dir;
+	dir_wait.wake();
 #ifdef INPLACE
 	s[0]->local_depth++;
 	s[0]->mutex.unlock();
 #endif
     }
     else{ // normal segment split
-	while(!dir->lock()){
-	    asm("nop");
-	}
+	dir_wait.wait_until([this]{ return dir->lock(); });
 
 	x = (f_hash >> (8 * sizeof(f_hash) - dir->depth));
 	if(dir->depth == target_local_depth + 1){
@@ -367,82 +463,55 @@ DIR_RETRY:
     goto RETRY;
 }
 
-template <typename Key_t>
-bool ExtendibleHash<Key_t>::Update(Key_t& key, Value_t value) {
-	size_t f_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	f_hash = hash_funcs[0](key, sizeof(Key_t), f_seed);
-    else
-	f_hash = hash_funcs[0](&key, sizeof(Key_t), f_seed);
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+bool ExtendibleHash<Key_t, Value_t, Hasher, Lock>::Update(Key_t& key, Value_t value) {
+    size_t f_hash = KT::hash(key, f_seed);
     auto f_idx = (f_hash & kMask) * kNumPairPerCacheLine;
 
+    backoff b;
 RETRY:
-    while(dir->sema < 0){
-	asm("nop");
-    }
+    wait_dir();
 
     auto x = (f_hash >> (8*sizeof(f_hash) - dir->depth)); 
     auto target = dir->_[x];
 
     if(!target){
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     /* acquire segment shared lock */
     if(!target->mutex.try_lock()){
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     auto target_check = (f_hash >> (8*sizeof(f_hash) - dir->depth));
     if(target != dir->_[target_check]){
 	target->mutex.unlock();
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     for (unsigned i = 0; i < kNumPairPerCacheLine * kNumCacheLine; ++i) {
-	auto loc = (f_idx+i) % Segment<Key_t>::kNumSlot;
-	if constexpr(sizeof(Key_t)>8){
-	    if(memcmp(target->_[loc].key, key, sizeof(Key_t)) == 0){
-		memcpy(&target->_[loc].value, &value, sizeof(Value_t));
-		target->mutex.unlock();
-		return true;
-	    }
-	}
-	else{
-	    if(memcmp(&target->_[loc].key, &key, sizeof(Key_t)) == 0){
-		memcpy(&target->_[loc].value, &value, sizeof(Value_t));
-		target->mutex.unlock();
-		return true;
-	    }
+	auto loc = (f_idx+i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	if(KT::equal(target->_[loc].key, key)){
+	    target->_[loc].value = value;
+	    target->mutex.unlock();
+	    return true;
 	}
     }
 
 #ifdef S_HASH
-    size_t s_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	s_hash = hash_funcs[2](key, sizeof(Key_t), s_seed);
-    else
-	s_hash = hash_funcs[2](&key, sizeof(Key_t), s_seed);
+    size_t s_hash = KT::hash(key, s_seed);
     auto s_idx = (s_hash & kMask) * kNumPairPerCacheLine;
 
     for(unsigned i=0; i<kNumPairPerCacheLine * kNumCacheLine; ++i){
-	auto loc = (s_idx+i) % Segment<Key_t>::kNumSlot;
-	if constexpr(sizeof(Key_t)>8){
-	    if(memcmp(target->_[loc].key, key, sizeof(Key_t)) == 0){
-		memcpy(&target->_[loc].value, &value, sizeof(Value_t));
-		target->mutex.unlock();
-		return true; 
-	    }
-	}
-	else{
-	    if(memcmp(&target->_[loc].key, &key, sizeof(Key_t)) == 0){
-		memcpy(&target->_[loc].value, &value, sizeof(Value_t));
-		target->mutex.unlock();
-		return true; 
-	    }
+	auto loc = (s_idx+i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	if(KT::equal(target->_[loc].key, key)){
+	    target->_[loc].value = value;
+	    target->mutex.unlock();
+	    return true; 
 	}
 
     }
@@ -453,82 +522,57 @@ RETRY:
 }
 
 // TODO
-template <typename Key_t>
-bool ExtendibleHash<Key_t>::Delete(Key_t& key) {
-	size_t f_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	f_hash = hash_funcs[0](key, sizeof(Key_t), f_seed);
-    else
-	f_hash = hash_funcs[0](&key, sizeof(Key_t), f_seed);
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+bool ExtendibleHash<Key_t, Value_t, Hasher, Lock>::Delete(Key_t& key) {
+    size_t f_hash = KT::hash(key, f_seed);
     auto f_idx = (f_hash & kMask) * kNumPairPerCacheLine;
 
+    backoff b;
 RETRY:
-    while(dir->sema < 0){
-	asm("nop");
-    }
+    wait_dir();
 
     auto x = (f_hash >> (8*sizeof(f_hash) - dir->depth)); 
     auto target = dir->_[x];
 
     if(!target){
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     /* acquire segment shared lock */
     if(!target->mutex.try_lock()){
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     auto target_check = (f_hash >> (8*sizeof(f_hash) - dir->depth));
     if(target != dir->_[target_check]){
 	target->mutex.unlock();
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     for (unsigned i = 0; i < kNumPairPerCacheLine * kNumCacheLine; ++i) {
-	auto loc = (f_idx+i) % Segment<Key_t>::kNumSlot;
-	if constexpr(sizeof(Key_t)>8){
-	    if(memcmp(target->_[loc].key, key, sizeof(Key_t)) == 0){
-		    memcpy(target->_[loc].key, INVALID<Key_t>, sizeof(Key_t));
-		target->mutex.unlock();
-		return true;
-	    }
-	}
-	else{
-	    if(memcmp(&target->_[loc].key, &key, sizeof(Key_t)) == 0){
-		    memcpy(&target->_[loc].key, &INVALID<Key_t>, sizeof(Key_t));
-		target->mutex.unlock();
-		return true;
-	    }
+	auto loc = (f_idx+i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	if(KT::equal(target->_[loc].key, key)){
+	    KT::clear(target->_[loc].key);
+	    target->mutex.unlock();
+	    pairs.add(-1);
+	    return true;
 	}
     }
 
 #ifdef S_HASH
-    size_t s_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	s_hash = hash_funcs[2](key, sizeof(Key_t), s_seed);
-    else
-	s_hash = hash_funcs[2](&key, sizeof(Key_t), s_seed);
+    size_t s_hash = KT::hash(key, s_seed);
     auto s_idx = (s_hash & kMask) * kNumPairPerCacheLine;
 
     for(unsigned i=0; i<kNumPairPerCacheLine * kNumCacheLine; ++i){
-	auto loc = (s_idx+i) % Segment<Key_t>::kNumSlot;
-	if constexpr(sizeof(Key_t)>8){
-	    if(memcmp(target->_[loc].key, key, sizeof(Key_t)) == 0){
-		    memcpy(target->_[loc].key, INVALID<Key_t>, sizeof(Key_t));
-		target->mutex.unlock();
-		return true; 
-	    }
-	}
-	else{
-	    if(memcmp(&target->_[loc].key, &key, sizeof(Key_t)) == 0){
-		    memcpy(&target->_[loc].key, &INVALID<Key_t>, sizeof(Key_t));
-		target->mutex.unlock();
-		return true; 
-	    }
+	auto loc = (s_idx+i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	if(KT::equal(target->_[loc].key, key)){
+	    KT::clear(target->_[loc].key);
+	    target->mutex.unlock();
+	    pairs.add(-1);
+	    return true;
 	}
 
     }
@@ -538,127 +582,467 @@ RETRY:
     return false; 
 }
 
-template <typename Key_t>
-char* ExtendibleHash<Key_t>::Get(Key_t& key) {
-    size_t f_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	f_hash = hash_funcs[0](key, sizeof(Key_t), f_seed);
-    else
-	f_hash = hash_funcs[0](&key, sizeof(Key_t), f_seed);
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+bool ExtendibleHash<Key_t, Value_t, Hasher, Lock>::Get(Key_t& key, Value_t& value) {
+    size_t f_hash = KT::hash(key, f_seed);
     auto f_idx = (f_hash & kMask) * kNumPairPerCacheLine;
 
+    backoff b;
 RETRY:
-    while(dir->sema < 0){
-	asm("nop");
-    }
+    wait_dir();
 
     auto x = (f_hash >> (8*sizeof(f_hash) - dir->depth)); 
     auto target = dir->_[x];
 
     if(!target){
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     /* acquire segment shared lock */
     if(!target->mutex.try_lock_shared()){
-	std::this_thread::yield();
+	b.pause();
 	goto RETRY;
     }
 
     auto target_check = (f_hash >> (8*sizeof(f_hash) - dir->depth));
     if(target != dir->_[target_check]){
-	target->mutex.unlock();
-	std::this_thread::yield();
+	target->mutex.unlock_shared();
+	b.pause();
 	goto RETRY;
     }
 
     for (unsigned i = 0; i < kNumPairPerCacheLine * kNumCacheLine; ++i) {
-	auto loc = (f_idx+i) % Segment<Key_t>::kNumSlot;
-	if constexpr(sizeof(Key_t)>8){
-	    if(memcmp(target->_[loc].key, key, sizeof(Key_t)) == 0){
-		Value_t v = target->_[loc].value;
-		target->mutex.unlock();
-		return (char*)v;
-	    }
-	}
-	else{
-	    if(memcmp(&target->_[loc].key, &key, sizeof(Key_t)) == 0){
-		Value_t v = target->_[loc].value;
-		target->mutex.unlock();
-		return (char*)v;
-	    }
+	auto loc = (f_idx+i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	if(KT::equal(target->_[loc].key, key)){
+	    value = VT::load(target->_[loc].value);
+	    target->mutex.unlock_shared();
+	    return true;
 	}
     }
 
 #ifdef S_HASH
-    size_t s_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	s_hash = hash_funcs[2](key, sizeof(Key_t), s_seed);
-    else
-	s_hash = hash_funcs[2](&key, sizeof(Key_t), s_seed);
+    size_t s_hash = KT::hash(key, s_seed);
     auto s_idx = (s_hash & kMask) * kNumPairPerCacheLine;
 
     for(unsigned i=0; i<kNumPairPerCacheLine * kNumCacheLine; ++i){
-	auto loc = (s_idx+i) % Segment<Key_t>::kNumSlot;
-	if constexpr(sizeof(Key_t)>8){
-	    if(memcmp(target->_[loc].key, key, sizeof(Key_t)) == 0){
-		Value_t v = target->_[loc].value;
-		target->mutex.unlock();
-		return (char*)v;
-	    }
-	}
-	else{
-	    if(memcmp(&target->_[loc].key, &key, sizeof(Key_t)) == 0){
-		Value_t v = target->_[loc].value;
-		target->mutex.unlock();
-		return (char*)v;
-	    }
+	auto loc = (s_idx+i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	if(KT::equal(target->_[loc].key, key)){
+	    value = VT::load(target->_[loc].value);
+	    target->mutex.unlock_shared();
+	    return true;
 	}
 
     }
 #endif
 
-    target->mutex.unlock();
-    return (char*)NONE;
+    target->mutex.unlock_shared();
+    return false;
+}
+
+/* Runs fn on the value slot of key (see util/value_traits.h) under the value_lock of its segment, which
+ * is only tried, as by the other segment operations, so that a split holding it is waited out with backoff. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+template <typename F>
+bool ExtendibleHash<Key_t, Value_t, Hasher, Lock>::apply(Key_t& key, F&& fn) {
+#ifdef S_HASH
+    const int num_probe = 2;
+#else
+    const int num_probe = 1;
+#endif
+    size_t f_hash = KT::hash(key, f_seed);
+
+    backoff b;
+RETRY:
+    wait_dir();
+
+    auto x = (f_hash >> (8*sizeof(f_hash) - dir->depth));
+    auto target = dir->_[x];
+
+    if(!target){
+	b.pause();
+	goto RETRY;
+    }
+
+    /* acquire segment shared lock, or exclusive one for values wider than a word */
+    value_lock<Value_t, Lock> lock(target->mutex, try_to_lock);
+    if(!lock.owns_lock()){
+	b.pause();
+	goto RETRY;
+    }
+
+    auto target_check = (f_hash >> (8*sizeof(f_hash) - dir->depth));
+    if(target != dir->_[target_check]){
+	lock.unlock();
+	b.pause();
+	goto RETRY;
+    }
+
+    for(int p=0; p<num_probe; p++){
+	auto start = probe_start(key, f_hash, p);
+	for(unsigned i=0; i<kNumPairPerCacheLine * kNumCacheLine; ++i){
+	    auto loc = (start + i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	    if(KT::equal(target->_[loc].key, key))
+		return fn(&target->_[loc].value);
+	}
+    }
+    return false;
 }
 
-template <typename Key_t>
-double ExtendibleHash<Key_t>::Utilization(void){
-    size_t sum = 0;
+/* first slot of the n-th probing range of key (the second one only exists with S_HASH) */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+size_t ExtendibleHash<Key_t, Value_t, Hasher, Lock>::probe_start(Key_t& key, size_t f_hash, int n) {
+    if(n == 0)
+	return (f_hash & kMask) * kNumPairPerCacheLine;
+    size_t s_hash = KT::hash(key, s_seed);
+    return (s_hash & kMask) * kNumPairPerCacheLine;
+}
+
+/* Applies op to every pair of the batch, one exclusive segment lock acquisition per segment.
+ * op(target, i, f_hash) returns 1 when applied, 0 when it definitely does not apply (e.g., key not found)
+ * and -1 when pair i has to go through fallback(i) (segment full, or the segment was split meanwhile). */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+template <typename Op, typename Fallback>
+size_t ExtendibleHash<Key_t, Value_t, Hasher, Lock>::batch(Pair<Key_t, Value_t>* kv, size_t num, Op&& op, Fallback&& fallback) {
+    vector<size_t> f_hash(num), group(num);
+    hash_batch<Key_t, Hasher>(kv, num, f_seed, f_hash.data());
+    auto depth = dir->depth;
+    for(size_t i=0; i<num; i++)
+	group[i] = (f_hash[i] >> (8*sizeof(size_t) - depth));
+
     size_t cnt = 0;
-    for(size_t i=0; i<dir->capacity; cnt++){
-	auto target = dir->_[i];
-	auto stride = pow(2, dir->depth - target->local_depth);
-	auto pattern = (i >> (dir->depth - target->local_depth));
-	for(unsigned j=0; j<Segment<Key_t>::kNumSlot; ++j){
-	    size_t key_hash;
-	    if constexpr(sizeof(Key_t) > 8){
-		key_hash = hash_funcs[0](target->_[j].key, sizeof(Key_t) ,f_seed);
-		if(((key_hash >> (8*sizeof(size_t) - target->local_depth)) == pattern) && (memcmp(target->_[j].key, INVALID<Key_t>, sizeof(Key_t)) != 0)){
-		    sum++;
+    vector<uint32_t> leftover;
+    for_each_group(group.data(), num, [&](size_t, const uint32_t* idx, size_t n){
+	    auto hash = f_hash[idx[0]];
+	    backoff b;
+RETRY:
+	    auto x = (hash >> (8*sizeof(hash) - dir->depth));
+	    auto target = dir->_[x];
+
+	    if(!target){
+		b.pause();
+		goto RETRY;
+	    }
+
+	    /* acquire segment exclusive lock */
+	    if(!target->mutex.try_lock()){
+		b.pause();
+		goto RETRY;
+	    }
+
+	    auto target_check = (hash >> (8*sizeof(hash) - dir->depth));
+	    if(target != dir->_[target_check]){
+		target->mutex.unlock();
+		b.pause();
+		goto RETRY;
+	    }
+
+	    for(size_t j=0; j<n; j++){
+		auto i = idx[j];
+		/* the directory may have been doubled since the batch was grouped */
+		if(target != dir->_[f_hash[i] >> (8*sizeof(size_t) - dir->depth)]){
+		    leftover.push_back(i);
+		    continue;
 		}
+		auto ret = op(target, i, f_hash[i]);
+		if(ret > 0)
+		    cnt++;
+		else if(ret < 0)
+		    leftover.push_back(i);
 	    }
-	    else{
-		key_hash = hash_funcs[0](&target->_[j].key, sizeof(Key_t), f_seed);
-		if(((key_hash >> (8*sizeof(key_hash)-target->local_depth)) == pattern) && (memcmp(&target->_[j].key, &INVALID<Key_t>, sizeof(Key_t)) != 0)){
-		    sum++;
+	    target->mutex.unlock();
+	});
+
+    for(auto i: leftover)
+	cnt += fallback(i);
+    return cnt;
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+void ExtendibleHash<Key_t, Value_t, Hasher, Lock>::InsertBatch(Pair<Key_t, Value_t>* kv, size_t num) {
+#ifdef S_HASH
+    const int num_probe = 2;
+#else
+    const int num_probe = 1;
+#endif
+    auto placed = batch(kv, num, [&](Segment<Key_t, Value_t, Hasher, Lock>* target, size_t i, size_t f_hash){
+	    auto target_local_depth = target->local_depth;
+	    auto pattern = (f_hash >> (8*sizeof(f_hash) - target_local_depth));
+	    for(int p=0; p<num_probe; p++){
+		auto start = probe_start(kv[i].key, f_hash, p);
+		for(unsigned k=0; k<kNumPairPerCacheLine * kNumCacheLine; ++k){
+		    auto loc = (start + k) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+		    if((((KT::hash(target->_[loc].key, f_seed) >> (8*sizeof(f_hash)-target_local_depth)) != pattern) ||
+				(KT::empty(target->_[loc].key)))){
+			KT::copy(target->_[loc].key, kv[i].key);
+			target->_[loc].value = kv[i].value;
+			return 1;
+		    }
+		}
+	    }
+	    /* segment is full, Insert() splits it */
+	    return -1;
+	}, [&](size_t i){
+	    /* counts itself */
+	    Insert(kv[i].key, kv[i].value);
+	    return false;
+	});
+    pairs.add(placed);
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+size_t ExtendibleHash<Key_t, Value_t, Hasher, Lock>::UpdateBatch(Pair<Key_t, Value_t>* kv, size_t num) {
+#ifdef S_HASH
+    const int num_probe = 2;
+#else
+    const int num_probe = 1;
+#endif
+    return batch(kv, num, [&](Segment<Key_t, Value_t, Hasher, Lock>* target, size_t i, size_t f_hash){
+	    for(int p=0; p<num_probe; p++){
+		auto start = probe_start(kv[i].key, f_hash, p);
+		for(unsigned k=0; k<kNumPairPerCacheLine * kNumCacheLine; ++k){
+		    auto loc = (start + k) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+		    if(KT::equal(target->_[loc].key, kv[i].key)){
+			target->_[loc].value = kv[i].value;
+			return 1;
+		    }
 		}
 	    }
+	    return 0;
+	}, [&](size_t i){
+	    return Update(kv[i].key, kv[i].value);
+	});
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+size_t ExtendibleHash<Key_t, Value_t, Hasher, Lock>::DeleteBatch(Pair<Key_t, Value_t>* kv, size_t num) {
+#ifdef S_HASH
+    const int num_probe = 2;
+#else
+    const int num_probe = 1;
+#endif
+    return batch(kv, num, [&](Segment<Key_t, Value_t, Hasher, Lock>* target, size_t i, size_t f_hash){
+	    for(int p=0; p<num_probe; p++){
+		auto start = probe_start(kv[i].key, f_hash, p);
+		for(unsigned k=0; k<kNumPairPerCacheLine * kNumCacheLine; ++k){
+		    auto loc = (start + k) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+		    if(KT::equal(target->_[loc].key, kv[i].key)){
+			KT::clear(target->_[loc].key);
+			pairs.add(-1);
+			return 1;
+		    }
+		}
+	    }
+	    return 0;
+	}, [&](size_t i){
+	    return Delete(kv[i].key);
+	});
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+task<bool> ExtendibleHash<Key_t, Value_t, Hasher, Lock>::GetCoro(Key_t& key, Value_t& value) {
+    size_t f_hash = KT::hash(key, f_seed);
+    size_t probe[2];
+    int num_probe = 0;
+    probe[num_probe++] = (f_hash & kMask) * kNumPairPerCacheLine;
+#ifdef S_HASH
+    size_t s_hash = KT::hash(key, s_seed);
+    probe[num_probe++] = (s_hash & kMask) * kNumPairPerCacheLine;
+#endif
+
+    backoff b;
+RETRY:
+    wait_dir();
+
+    auto x = (f_hash >> (8*sizeof(f_hash) - dir->depth));
+    co_await prefetch(&dir->_[x], sizeof(Segment<Key_t, Value_t, Hasher, Lock>*));
+    x = (f_hash >> (8*sizeof(f_hash) - dir->depth));
+    auto target = dir->_[x];
+
+    if(!target){
+	b.pause();
+	goto RETRY;
+    }
+
+    /* the segment lock is dropped before every suspension and re-validated after it,
+     * so that interleaved lookups on one thread never hold a lock across each other */
+    bool locked = false;
+    for(int p=0; p<num_probe; p++){
+	uintptr_t line = 0;
+	for(unsigned i=0; i<kNumPairPerCacheLine * kNumCacheLine; ++i){
+	    auto loc = (probe[p]+i) % Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot;
+	    auto last = ((uintptr_t)(&target->_[loc]+1) - 1) >> 6;
+	    if(last != line){
+		if(locked){
+		    target->mutex.unlock_shared();
+		    locked = false;
+		}
+		co_await prefetch(&target->_[loc], sizeof(Pair<Key_t, Value_t>));
+		line = last;
+
+		if(!target->mutex.try_lock_shared()){
+		    b.pause();
+		    goto RETRY;
+		}
+		auto target_check = (f_hash >> (8*sizeof(f_hash) - dir->depth));
+		if(target != dir->_[target_check]){
+		    target->mutex.unlock_shared();
+		    b.pause();
+		    goto RETRY;
+		}
+		locked = true;
+	    }
+
+	    if(KT::equal(target->_[loc].key, key)){
+		value = VT::load(target->_[loc].value);
+		target->mutex.unlock_shared();
+		co_return true;
+	    }
 	}
-	i += stride;
     }
-    return ((double)sum) / ((double)cnt * Segment<Key_t>::kNumSlot)*100.0;
+
+    if(locked)
+	target->mutex.unlock_shared();
+    co_return false;
 }
 
+/* Walks the hash space instead of the directory: every thread takes the segments whose hash range
+ * starts in its share of it. A split only divides the range of a segment, so a range that has been
+ * visited never has to be visited again, no matter how the directory changes meanwhile. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+template <typename F>
+void ExtendibleHash<Key_t, Value_t, Hasher, Lock>::ForEach(F&& fn, size_t num_threads) {
+    using pos_t = unsigned __int128;
+    const size_t kBits = 8*sizeof(size_t);
+    parallel_run(num_threads, [&](size_t tid){
+	    pos_t from = ((pos_t)1 << kBits) * tid / num_threads;
+	    pos_t to = ((pos_t)1 << kBits) * (tid+1) / num_threads;
+	    vector<Pair<Key_t, Value_t>> buf;
+	    buf.reserve(Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot);
+	    auto pos = from;
+	    while(pos < to){
+		size_t hash = (size_t)pos;
+		backoff b;
+RETRY:
+		wait_dir();
+		auto _dir = dir;
+		auto target = _dir->_[_dir->depth ? hash >> (kBits - _dir->depth) : 0];
+		if(!target->mutex.try_lock_shared()){
+		    b.pause();
+		    goto RETRY;
+		}
+		_dir = dir;
+		if(target != _dir->_[_dir->depth ? hash >> (kBits - _dir->depth) : 0]){
+		    target->mutex.unlock_shared();
+		    b.pause();
+		    goto RETRY;
+		}
+
+		pos_t span = (pos_t)1 << (kBits - target->local_depth);
+		pos_t start = pos - pos % span;
+		buf.clear();
+		/* a segment starting before from belongs to the previous thread */
+		if(start >= from){
+		    for(unsigned i=0; i<Segment<Key_t, Value_t, Hasher, Lock>::kNumSlot; ++i){
+			if(KT::empty(target->_[i].key))
+			    continue;
+#ifdef INPLACE
+			/* pairs left behind by an in-place split */
+			if(target->local_depth && (KT::hash(target->_[i].key, f_seed) >> (kBits - target->local_depth)) != (hash >> (kBits - target->local_depth)))
+			    continue;
+#endif
+			buf.emplace_back(target->_[i].key, VT::load(target->_[i].value));
+		    }
+		}
+		target->mutex.unlock_shared();
 
-template <typename Key_t>
-size_t ExtendibleHash<Key_t>::Capacity(void) {
-    size_t cnt = 0;
-    for(int i=0; i<dir->capacity; cnt++){
+		if(!buf.empty())
+		    fn(buf.data(), buf.size());
+		pos = start + span;
+	    }
+	});
+}
+
+/* Unless the directory is already deep enough for the pairs in the table and num more, it is rebuilt at
+ * the depth that fits them, one segment per entry, and the pairs are filled back in. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+void ExtendibleHash<Key_t, Value_t, Hasher, Lock>::reserve(size_t num, size_t num_threads) {
+    if(planned(Size() + num, load_factor) <= dir->depth)
+	return;
+    vector<Pair<Key_t, Value_t>> all;
+    std::mutex all_mutex;
+    ForEach([&](const Pair<Key_t, Value_t>* p, size_t n){
+	    lock_guard<std::mutex> lock(all_mutex);
+	    all.insert(all.end(), p, p+n);
+	}, num_threads);
+
+    auto depth = planned(all.size() + num, load_factor);
+    auto _dir = new Directory<Key_t, Value_t, Hasher, Lock>(depth);
+    parallel_run(num_threads, [&](size_t tid){
+	    for(size_t x=_dir->capacity*tid/num_threads; x<_dir->capacity*(tid+1)/num_threads; x++)
+		_dir->_[x] = new Segment<Key_t, Value_t, Hasher, Lock>(depth);
+	});
+    /* nothing else runs meanwhile, so the old segments can go right away */
+    for(size_t i=0; i<dir->capacity;){
 	auto target = dir->_[i];
-	auto stride = pow(2, dir->depth - target->local_depth);
-	i += stride;
+	i += (size_t)1 << (dir->depth - target->local_depth);
+	delete target;
     }
-    return cnt * Segment<Key_t>::kNumSlot;
+    delete[] dir->_;
+    delete dir;
+    dir = _dir;
+    segments = _dir->capacity;
+    pairs.set(0);
+    fill(all.data(), all.size(), num_threads);
+}
+
+/* Pairs are partitioned by directory entry and every thread fills the segments that start in its range of
+ * entries, without locks; pairs that do not fit in their segment are left to Insert, which splits as usual. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Lock>
+void ExtendibleHash<Key_t, Value_t, Hasher, Lock>::fill(Pair<Key_t, Value_t>* kv, size_t num, size_t num_threads) {
+    const size_t kBits = 8*sizeof(size_t);
+    auto depth = dir->depth;
+    vector<uint32_t> order;
+    vector<size_t> bounds;
+    parallel_partition(num, dir->capacity, num_threads, [&](size_t from, size_t n, uint32_t* id){
+	    size_t f_hash[kHashBatch];
+	    for(size_t i=0; i<n; i+=kHashBatch){
+		auto m = std::min(kHashBatch, n - i);
+		hash_batch<Key_t, Hasher>(&kv[from+i], m, f_seed, f_hash);
+		for(size_t j=0; j<m; j++)
+		    id[i+j] = depth ? f_hash[j] >> (kBits - depth) : 0;
+	    }
+	}, order, bounds);
+
+    vector<vector<uint32_t>> overflow(num_threads);
+    parallel_run(num_threads, [&](size_t tid){
+	    for(size_t x=dir->capacity*tid/num_threads; x<dir->capacity*(tid+1)/num_threads; x++){
+		auto target = dir->_[x];
+		size_t stride = (size_t)1 << (depth - target->local_depth);
+		if(x % stride)
+		    continue;
+		for(size_t j=bounds[x]; j<bounds[x+stride]; j++){
+		    auto i = order[j];
+		    size_t f_hash = KT::hash(kv[i].key, f_seed);
+		    if(target->Insert4split(kv[i].key, kv[i].value, (f_hash & kMask)*kNumPairPerCacheLine))
+			continue;
+#ifdef S_HASH
+		    size_t s_hash = KT::hash(kv[i].key, s_seed);
+		    if(target->Insert4split(kv[i].key, kv[i].value, (s_hash & kMask)*kNumPairPerCacheLine))
+			continue;
+#endif
+		    overflow[tid].push_back(i);
+		}
+	    }
+	});
+
+    size_t placed = num;
+    for(auto& o: overflow)
+	placed -= o.size();
+    pairs.add(placed);
+
+    parallel_run(num_threads, [&](size_t tid){
+	    for(auto i: overflow[tid])
+		Insert(kv[i].key, kv[i].value);
+	});
 }
@@ -0,0 +1,173 @@
+#ifndef FROZEN_INDEX_H_
+#define FROZEN_INDEX_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdlib>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include <functional>
+
+#include "util/pair.h"
+#include "util/key_traits.h"
+#include "util/mphf.h"
+#include "index/interface.h"
+
+using namespace std;
+
+/* Read-only phases over an index: Freeze() copies the pairs of the index into an immutable table
+ * ordered by a minimal perfect hash of their keys (see util/mphf.h), and until Thaw() every lookup
+ * goes there instead: no lock, no probe, a pilot and one pair, so one or two cache lines. The table
+ * holds exactly Size() pairs. Writes to a frozen index are a bug and exit. Freeze and Thaw must not
+ * run concurrently with any other operation; the index keeps its pairs meanwhile, so Thaw() only
+ * drops the frozen copy. */
+template <typename Key_t, typename Value_t = default_value>
+class FrozenIndex final : public Hash<Key_t, Value_t> {
+  using KT = KeyTraits<Key_t>;
+  public:
+    FrozenIndex(Hash<Key_t, Value_t>* _index): index(_index), pairs(nullptr), num(0){ }
+    ~FrozenIndex(void){
+	Thaw();
+    }
+
+    /* collects the pairs with ForEach on num_threads threads, then builds the hash function on one */
+    void Freeze(size_t num_threads = 1){
+	Thaw();
+	std::vector<Pair<Key_t, Value_t>> kv;
+	kv.reserve(index->Size());
+	std::mutex m;
+	index->ForEach([&kv, &m](const Pair<Key_t, Value_t>* chunk, size_t n){
+		lock_guard<std::mutex> lock(m);
+		kv.insert(kv.end(), chunk, chunk + n);
+	    }, num_threads);
+	num = kv.size();
+	mph.build(kv.data(), num);
+	pairs = (Pair<Key_t, Value_t>*)aligned_alloc(64, std::max(num * sizeof(Pair<Key_t, Value_t>), (size_t)64));
+	if(!pairs){
+	    fprintf(stderr, "%s: failed to allocate %zu frozen pairs\n", __func__, num);
+	    exit(1);
+	}
+	for(auto& p: kv)
+	    pairs[mph(p.key)] = p;
+    }
+    void Thaw(void){
+	free(pairs);
+	pairs = nullptr;
+	num = 0;
+    }
+    bool Frozen(void){ return pairs != nullptr; }
+    /* size of the frozen table and its hash function */
+    size_t Bytes(void){ return num * sizeof(Pair<Key_t, Value_t>) + mph.Bytes(); }
+
+    bool Get(Key_t& key, Value_t& value){
+	if(!pairs)
+	    return index->Get(key, value);
+	if(num == 0)
+	    return false;
+	auto& p = pairs[mph(key)];
+	if(!KT::equal(p.key, key))
+	    return false;
+	value = p.value;
+	return true;
+    }
+    task<bool> GetCoro(Key_t& key, Value_t& value){
+	if(!pairs)
+	    return index->GetCoro(key, value);
+	return get_coro(key, value);
+    }
+
+    void Insert(Key_t& key, Value_t value){
+	writable(__func__);
+	index->Insert(key, value);
+    }
+    bool Upsert(Key_t& key, Value_t value){
+	writable(__func__);
+	return index->Upsert(key, value);
+    }
+    bool GetOrInsert(Key_t& key, Value_t& value){
+	writable(__func__);
+	return index->GetOrInsert(key, value);
+    }
+    bool FetchAdd(Key_t& key, Value_t delta, Value_t* prev = nullptr){
+	writable(__func__);
+	return index->FetchAdd(key, delta, prev);
+    }
+    bool CompareExchange(Key_t& key, Value_t& expected, Value_t desired){
+	writable(__func__);
+	return index->CompareExchange(key, expected, desired);
+    }
+    bool Modify(Key_t& key, const function<Value_t(Value_t)>& fn){
+	writable(__func__);
+	return index->Modify(key, fn);
+    }
+    bool Update(Key_t& key, Value_t value){
+	writable(__func__);
+	return index->Update(key, value);
+    }
+    bool Delete(Key_t& key){
+	writable(__func__);
+	return index->Delete(key);
+    }
+    void InsertBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	writable(__func__);
+	index->InsertBatch(kv, num);
+    }
+    size_t UpdateBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	writable(__func__);
+	return index->UpdateBatch(kv, num);
+    }
+    size_t DeleteBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	writable(__func__);
+	return index->DeleteBatch(kv, num);
+    }
+    void Reserve(size_t num){
+	writable(__func__);
+	index->Reserve(num);
+    }
+    void BulkLoad(Pair<Key_t, Value_t>* kv, size_t num, size_t num_threads = 1){
+	writable(__func__);
+	index->BulkLoad(kv, num, num_threads);
+    }
+
+    /* frozen, a single pass over the table */
+    void ForEach(const function<void(const Pair<Key_t, Value_t>*, size_t)>& fn, size_t num_threads = 1){
+	if(!pairs){
+	    index->ForEach(fn, num_threads);
+	    return;
+	}
+	if(num)
+	    fn(pairs, num);
+    }
+    size_t Size(void){ return index->Size(); }
+    double Utilization(void){ return pairs ? 100 : index->Utilization(); }
+    size_t Capacity(void){ return pairs ? num : index->Capacity(); }
+    void FindAnyway(Key_t& key){ index->FindAnyway(key); }
+
+  private:
+    void writable(const char* op){
+	if(pairs){
+	    fprintf(stderr, "FrozenIndex::%s: the index is frozen, Thaw() it first\n", op);
+	    exit(1);
+	}
+    }
+
+    task<bool> get_coro(Key_t& key, Value_t& value){
+	if(num == 0)
+	    co_return false;
+	co_await prefetch(mph.pilot_of(key), sizeof(uint16_t));
+	auto& p = pairs[mph(key)];
+	co_await prefetch(&p, sizeof(Pair<Key_t, Value_t>));
+	if(!KT::equal(p.key, key))
+	    co_return false;
+	value = p.value;
+	co_return true;
+    }
+
+    Hash<Key_t, Value_t>* index;
+    mphf<Key_t> mph;
+    Pair<Key_t, Value_t>* pairs;
+    size_t num;
+};
+
+#endif  // FROZEN_INDEX_H_
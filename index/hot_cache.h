@@ -0,0 +1,226 @@
+#ifndef HOT_CACHE_H_
+#define HOT_CACHE_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+
+#include "util/pair.h"
+#include "util/key_traits.h"
+#include "util/counter.h"
+#include "index/interface.h"
+
+using namespace std;
+
+/* Read cache in front of an index for skewed workloads: every thread keeps the pairs it has read in a
+ * small direct-mapped table of its own, so a read of a hot key costs a hash, a key compare and a version
+ * check instead of a probe under the stripe lock all the threads fight over.
+ * Keys map to kStripes version counters. A write bumps the version of its key before it goes to the
+ * index and again after it; a cached pair carries the version read before the lookup that brought it
+ * in and is used only while that version is current. The first bump stops reads of a pair that is about
+ * to change, the second drops pairs cached while the write was in flight. Writes must not bypass the
+ * cache. */
+template <typename Key_t, typename Value_t = default_value>
+class HotCache final : public Hash<Key_t, Value_t> {
+  using KT = KeyTraits<Key_t>;
+  public:
+    static const size_t kEntries = 1024;  // per thread
+    static const size_t kStripes = 4096;
+    static const uint32_t kMaxScore = 3;
+    static const uint32_t kFlush = 256;  // lookups a thread counts before adding them to hits/misses
+
+    HotCache(Hash<Key_t, Value_t>* _index): index(_index), id(__atomic_add_fetch(&instances, 1, __ATOMIC_RELAXED)){
+	for(size_t i=0; i<kStripes; i++)
+	    versions[i] = 0;
+    }
+    ~HotCache(void){ }
+
+    bool Get(Key_t& key, Value_t& value){
+	auto key_hash = KT::hash(key);
+	auto& l = local();
+	auto& e = l.entry[key_hash % kEntries];
+	auto v = __atomic_load_n(&versions[stripe(key_hash)], __ATOMIC_ACQUIRE);
+	if(e.version == v && KT::equal(e.key, key)){
+	    if(e.score < kMaxScore)
+		e.score++;
+	    l.count(true, hits, misses);
+	    value = e.value;
+	    return true;
+	}
+	l.count(false, hits, misses);
+	if(!index->Get(key, value))
+	    return false;
+	/* another pair gives its slot up only after as many misses on it as it had hits */
+	if(e.score && !KT::equal(e.key, key)){
+	    e.score--;
+	    return true;
+	}
+	KT::copy(e.key, key);
+	e.value = value;
+	e.version = v;
+	e.score = 0;
+	return true;
+    }
+
+    /* hits are answered at once, misses go to the index and are not cached */
+    task<bool> GetCoro(Key_t& key, Value_t& value){
+	auto key_hash = KT::hash(key);
+	auto& l = local();
+	auto& e = l.entry[key_hash % kEntries];
+	if(e.version == __atomic_load_n(&versions[stripe(key_hash)], __ATOMIC_ACQUIRE) && KT::equal(e.key, key)){
+	    l.count(true, hits, misses);
+	    value = e.value;
+	    return ready(true);
+	}
+	l.count(false, hits, misses);
+	return index->GetCoro(key, value);
+    }
+
+    void Insert(Key_t& key, Value_t value){
+	writer w(this, key);
+	index->Insert(key, value);
+    }
+    bool Upsert(Key_t& key, Value_t value){
+	writer w(this, key);
+	return index->Upsert(key, value);
+    }
+    bool GetOrInsert(Key_t& key, Value_t& value){
+	writer w(this, key);
+	return index->GetOrInsert(key, value);
+    }
+    bool FetchAdd(Key_t& key, Value_t delta, Value_t* prev = nullptr){
+	writer w(this, key);
+	return index->FetchAdd(key, delta, prev);
+    }
+    bool CompareExchange(Key_t& key, Value_t& expected, Value_t desired){
+	writer w(this, key);
+	return index->CompareExchange(key, expected, desired);
+    }
+    bool Modify(Key_t& key, const function<Value_t(Value_t)>& fn){
+	writer w(this, key);
+	return index->Modify(key, fn);
+    }
+    bool Update(Key_t& key, Value_t value){
+	writer w(this, key);
+	return index->Update(key, value);
+    }
+    bool Delete(Key_t& key){
+	writer w(this, key);
+	return index->Delete(key);
+    }
+
+    void InsertBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	bump(kv, num);
+	index->InsertBatch(kv, num);
+	bump(kv, num);
+    }
+    size_t UpdateBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	bump(kv, num);
+	auto ret = index->UpdateBatch(kv, num);
+	bump(kv, num);
+	return ret;
+    }
+    size_t DeleteBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	bump(kv, num);
+	auto ret = index->DeleteBatch(kv, num);
+	bump(kv, num);
+	return ret;
+    }
+
+    void Reserve(size_t num){
+	index->Reserve(num);
+    }
+    /* runs alone, so every cached pair can simply be dropped */
+    void BulkLoad(Pair<Key_t, Value_t>* kv, size_t num, size_t num_threads = 1){
+	for(size_t i=0; i<kStripes; i++)
+	    versions[i]++;
+	index->BulkLoad(kv, num, num_threads);
+    }
+    void ForEach(const function<void(const Pair<Key_t, Value_t>*, size_t)>& fn, size_t num_threads = 1){
+	index->ForEach(fn, num_threads);
+    }
+
+    size_t Size(void){ return index->Size(); }
+    double Utilization(void){ return index->Utilization(); }
+    size_t Capacity(void){ return index->Capacity(); }
+    void FindAnyway(Key_t& key){ index->FindAnyway(key); }
+
+    /* hit counts reach these a batch of kFlush lookups at a time */
+    size_t Hits(void){ return hits.sum(); }
+    size_t Lookups(void){ return hits.sum() + misses.sum(); }
+    double HitRate(void){
+	auto lookups = Lookups();
+	return lookups ? ((double)Hits()) / ((double)lookups)*100 : 0;
+    }
+
+  private:
+    static const uint64_t kInvalid = ~(uint64_t)0;  // never a version
+
+    struct entry_t{
+	Key_t key;
+	Value_t value;
+	uint64_t version = kInvalid;
+	uint32_t score = 0;
+    };
+
+    /* a thread's cache belongs to the last instance it used */
+    struct local_t{
+	uint64_t owner = 0;
+	uint32_t hits = 0;
+	uint32_t lookups = 0;
+	entry_t entry[kEntries];
+
+	void count(bool hit, sharded_counter& _hits, sharded_counter& _misses){
+	    hits += hit;
+	    if(++lookups == kFlush){
+		_hits.add(hits);
+		_misses.add(lookups - hits);
+		hits = lookups = 0;
+	    }
+	}
+    };
+
+    local_t& local(void){
+	static thread_local local_t l;
+	if(l.owner != id){
+	    for(auto& e: l.entry)
+		e.version = kInvalid;
+	    l.owner = id;
+	    l.hits = l.lookups = 0;
+	}
+	return l;
+    }
+
+    struct writer{
+	uint64_t* version;
+	writer(HotCache* cache, Key_t& key): version(&cache->versions[stripe(KT::hash(key))]){
+	    __atomic_fetch_add(version, 1, __ATOMIC_SEQ_CST);
+	}
+	~writer(void){
+	    __atomic_fetch_add(version, 1, __ATOMIC_RELEASE);
+	}
+    };
+
+    void bump(Pair<Key_t, Value_t>* kv, size_t num){
+	for(size_t i=0; i<num; i++)
+	    __atomic_fetch_add(&versions[stripe(KT::hash(kv[i].key))], 1, __ATOMIC_SEQ_CST);
+    }
+
+    static size_t stripe(size_t key_hash){
+	return (key_hash >> 32) % kStripes;
+    }
+
+    static task<bool> ready(bool found){
+	co_return found;
+    }
+
+    static inline uint64_t instances = 0;
+
+    Hash<Key_t, Value_t>* index;
+    uint64_t id;
+    sharded_counter hits;
+    sharded_counter misses;
+    uint64_t versions[kStripes];
+};
+
+#endif  // HOT_CACHE_H_
@@ -3,26 +3,87 @@
 
 #define CAS(_p, _u, _v)  (__atomic_compare_exchange_n (_p, _u, _v, false, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
 
+#include <functional>
+
 #include "util/pair.h"
 #include "util/timer.h"
+#include "util/coroutine.h"
 
 uint64_t split_time = 0;
 uint64_t cuckoo_time = 0;
 
 struct timespec t_start, t_end;
 
-template <typename Key_t>
+template <typename Key_t, typename Value_t = default_value>
 class Hash {
   public:
     Hash(void) = default;
-    ~Hash(void) = default;
+    /* engines and wrappers are deleted through Hash* */
+    virtual ~Hash(void) = default;
     virtual void Insert(Key_t&, Value_t) = 0;
+    /* insert-or-assign in a single probe; returns true if key was not there */
+    virtual bool Upsert(Key_t&, Value_t) = 0;
+    /* inserts (key, value) and returns true if key was not there, otherwise copies its value to value */
+    virtual bool GetOrInsert(Key_t&, Value_t& value) = 0;
+    /* atomic operations on the value of key, applied in place under a shared lock so that they never
+     * wait for each other (values wider than a word take the exclusive one, see util/value_traits.h);
+     * all return false if key is not there. CompareExchange stores the current
+     * value in expected when it does not match, Modify retries fn until its result is swapped in. */
+    virtual bool FetchAdd(Key_t&, Value_t delta, Value_t* prev = nullptr) = 0;
+    virtual bool CompareExchange(Key_t&, Value_t& expected, Value_t desired) = 0;
+    virtual bool Modify(Key_t&, const std::function<Value_t(Value_t)>& fn) = 0;
+    /* Full scan on num_threads threads. fn(kv, num) gets copies of the pairs, a stripe or segment at a time,
+     * taken under its shared lock, outside of any lock. Every pair that is in the table for the whole scan
+     * is passed exactly once; pairs inserted or deleted meanwhile may or may not be. Resizes and cuckoo
+     * displacements wait for running scans (extendible hashing splits do not), so fn must not insert. */
+    virtual void ForEach(const std::function<void(const Pair<Key_t, Value_t>*, size_t)>& fn, size_t num_threads = 1) = 0;
     virtual bool Update(Key_t&, Value_t) = 0;
     virtual bool Delete(Key_t&) = 0;
-    virtual char* Get(Key_t&) = 0;
+    /* copies the value of key to value; false if key is not there */
+    virtual bool Get(Key_t&, Value_t& value) = 0;
+    /* number of pairs, exact when no write is in flight */
+    virtual size_t Size(void) = 0;
     virtual double Utilization(void) = 0;
     virtual size_t Capacity(void) = 0;
     virtual void FindAnyway(Key_t&) = 0;
+    /* batched writes; engines group a batch by lock and apply each group under one acquisition */
+    virtual void InsertBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	for(size_t i=0; i<num; i++)
+	    Insert(kv[i].key, kv[i].value);
+    }
+    virtual size_t UpdateBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	size_t cnt = 0;
+	for(size_t i=0; i<num; i++)
+	    cnt += Update(kv[i].key, kv[i].value);
+	return cnt;
+    }
+    virtual size_t DeleteBatch(Pair<Key_t, Value_t>* kv, size_t num){
+	size_t cnt = 0;
+	for(size_t i=0; i<num; i++)
+	    cnt += Delete(kv[i].key);
+	return cnt;
+    }
+    /* Grows the table once so that num more pairs fit at the planned load factor (see the
+     * (expected, load_factor) constructors) without resizes or splits. */
+    virtual void Reserve(size_t num) = 0;
+    /* Loads num pairs with distinct keys, not in the table yet, on num_threads threads: the table is sized
+     * for them once, the pairs are partitioned by home slot range and every range is filled without locks.
+     * Reserve and BulkLoad must not run concurrently with any other operation. */
+    virtual void BulkLoad(Pair<Key_t, Value_t>* kv, size_t num, size_t num_threads = 1) = 0;
+    /* interleavable lookup; suspends before touching cache lines that may miss */
+    virtual task<bool> GetCoro(Key_t& key, Value_t& value){
+	co_return Get(key, value);
+    }
+};
+
+/* An index that also keeps its keys in order (see index/btree_olc.h). */
+template <typename Key_t, typename Value_t = default_value>
+class OrderedIndex : public Hash<Key_t, Value_t> {
+  public:
+    /* Copies up to count pairs with keys >= start, in key order, to out and returns how many it copied.
+     * Every pair is read consistently with its neighbours in the same node; the scan as a whole is not a
+     * snapshot: pairs inserted or deleted behind the cursor meanwhile may or may not be returned. */
+    virtual size_t Scan(Key_t& start, size_t count, Pair<Key_t, Value_t>* out) = 0;
 };
 
 
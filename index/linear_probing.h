@@ -9,44 +9,106 @@
 
 #include "util/hash.h"
 #include "util/pair.h"
+#include "util/key_traits.h"
+#include "util/hash_batch.h"
+#include "util/batch.h"
+#include "util/parallel.h"
+#include "util/counter.h"
+#include "util/layout.h"
+#include "util/rwlock.h"
+#include "util/wait.h"
 #include "index/interface.h"
 
 using namespace std;
 
-template <typename Key_t>
-class LinearProbingHash : public Hash <Key_t> {
+template <typename Key_t, typename Value_t = default_value, typename Hasher = default_hash, typename Layout = default_layout, typename Lock = default_lock>
+class LinearProbingHash final : public Hash<Key_t, Value_t> {
   const float kResizingFactor = 2;
   const float kResizingThreshold = 0.95;
+  const size_t kBulkPartition = 4096;  // slots per BulkLoad partition
+  const size_t kRehashChunk = 4096;  // old slots per rehash chunk
+  using KT = KeyTraits<Key_t, Hasher>;
+  using VT = ValueTraits<Value_t>;
+  using table_t = typename Layout::template table<Key_t, Value_t>;
+  using lock_t = padded_lock<Lock>;
   public:
-    LinearProbingHash(void): capacity{0}, dict{nullptr}{ }
-    LinearProbingHash(size_t _capacity): capacity{_capacity}, dict{new Pair<Key_t>[capacity]} {
+    LinearProbingHash(void): capacity{0}, dict{nullptr}, mutex{nullptr}{ }
+    LinearProbingHash(size_t _capacity): capacity{_capacity}, dict{new table_t(capacity)} {
 	locksize = 256;
 	nlocks = capacity / locksize + 1;
-	mutex = new shared_mutex[nlocks];
+	mutex = new lock_t[nlocks];
+	invalid_initialize<Key_t>();
+    }
+    /* sized for expected pairs at load_factor, which Reserve and BulkLoad plan with as well */
+    LinearProbingHash(size_t expected, float _load_factor): load_factor{_load_factor} {
+	capacity = planned(expected, load_factor);
+	dict = new table_t(capacity);
+	locksize = 256;
+	nlocks = capacity / locksize + 1;
+	mutex = new lock_t[nlocks];
 	invalid_initialize<Key_t>();
     }
     ~LinearProbingHash(void){
-	if(dict != nullptr) delete[] dict;
+	if(dict != nullptr) delete dict;
+	delete[] mutex;
+	for(auto& it: retired){
+	    delete[] it.first;
+	    delete it.second;
+	}
     }
 
     void Insert(Key_t&, Value_t);
+    bool Upsert(Key_t& key, Value_t value){
+	return upsert(key, value, true);
+    }
+    bool GetOrInsert(Key_t& key, Value_t& value){
+	return upsert(key, value, false);
+    }
     bool Update(Key_t&, Value_t);
+    bool FetchAdd(Key_t& key, Value_t delta, Value_t* prev = nullptr){
+	return apply(key, [&](Value_t* v){
+		auto old = VT::fetch_add(*v, delta);
+		if(prev) *prev = old;
+		return true;
+	    });
+    }
+    bool CompareExchange(Key_t& key, Value_t& expected, Value_t desired){
+	return apply(key, [&](Value_t* v){
+		return VT::compare_exchange(*v, expected, desired);
+	    });
+    }
+    template <typename F>
+    bool Modify(Key_t& key, F&& fn){
+	return apply(key, [&](Value_t* v){
+		auto old = VT::load(*v);
+		while(!VT::compare_exchange(*v, old, fn(old)));
+		return true;
+	    });
+    }
+    bool Modify(Key_t& key, const function<Value_t(Value_t)>& fn){
+	return Modify<const function<Value_t(Value_t)>&>(key, fn);
+    }
     bool Delete(Key_t&);
-    char* Get(Key_t&);
+    bool Get(Key_t&, Value_t&);
+    void InsertBatch(Pair<Key_t, Value_t>*, size_t);
+    size_t UpdateBatch(Pair<Key_t, Value_t>*, size_t);
+    size_t DeleteBatch(Pair<Key_t, Value_t>*, size_t);
+    void Reserve(size_t num){
+	reserve(num, 1);
+    }
+    void BulkLoad(Pair<Key_t, Value_t>*, size_t, size_t num_threads = 1);
+    task<bool> GetCoro(Key_t&, Value_t&);
+    template <typename F>
+    void ForEach(F&&, size_t num_threads = 1);
+    void ForEach(const function<void(const Pair<Key_t, Value_t>*, size_t)>& fn, size_t num_threads = 1){
+	ForEach<const function<void(const Pair<Key_t, Value_t>*, size_t)>&>(fn, num_threads);
+    }
     void FindAnyway(Key_t&);
+    size_t Size(void){
+	return pairs.sum();
+    }
     double Utilization(void){
-	size_t size = 0;
-	for(int i=0; i<capacity; i++){
-	    if constexpr(sizeof(Key_t) > 8){
-		if(memcmp(dict[i].key, INVALID<Key_t>, sizeof(Key_t)) != 0)
-		    size++;
-	    }
-	    else{
-		if(memcmp(&dict[i].key, &INVALID<Key_t>, sizeof(Key_t)) != 0)
-		    size++;
-	    }
-	}
-	return ((double)size) / ((double)capacity)*100;
+	return ((double)Size()) / ((double)capacity)*100;
     }
 
     size_t Capacity(void) {
@@ -54,258 +116,579 @@ class LinearProbingHash : public Hash <Key_t> {
     }
 
   private:
-    void resize(size_t);
-    size_t getLocation(size_t, size_t, Pair<Key_t>*);
+    template <typename F>
+    bool apply(Key_t&, F&&);
+    bool upsert(Key_t&, Value_t&, bool);
+    void grow(void);
+    /* waits out a running resize, helping with its rehash meanwhile */
+    void wait_resize(void){
+	resize_wait.wait_until([this]{
+		if(!__atomic_load_n(&resizing_lock, __ATOMIC_SEQ_CST))
+		    return true;
+		rehash.help();
+		return false;
+	    });
+    }
+    void end_resize(void){
+	__atomic_store_n(&resizing_lock, 0, __ATOMIC_SEQ_CST);
+	resize_wait.wake();
+    }
+    void resize(size_t, size_t num_threads = 1);
+    void reserve(size_t, size_t);
+    size_t planned(size_t num, float _load_factor){
+	/* the table must stay below the resizing threshold */
+	return num / std::min(_load_factor, kResizingThreshold) + 1;
+    }
+    template <typename Op, typename Fallback>
+    size_t batch(Pair<Key_t, Value_t>*, size_t, Op&&, Fallback&&);
 
     size_t capacity;
-    Pair<Key_t>* dict;
+    table_t* dict;
 
-    size_t old_cap;
-    Pair<Key_t>* old_dic;
+    /* stripe locks and tables replaced by resizes: writers blocked on an old stripe lock unlock it once
+     * they see the new table, and lookups may still be reading the old one, so both are freed with the index */
+    vector<std::pair<lock_t*, table_t*>> retired;
 
-    size_t size = 0;
+    sharded_counter size;  // non-empty slots, deleted ones included
+    sharded_counter pairs;  // live pairs
+    float load_factor = 0.5;  // planned load of Reserve and BulkLoad
 
     int resizing_lock = 0;
-    std::shared_mutex *mutex;
+    int scanners = 0;  // running ForEach calls, resizes wait for them
+    chunk_pool rehash;  // threads waiting for a resize help with the rehash
+    wait_queue resize_wait;  // and sleep on it once there is nothing left to help with
+    lock_t *mutex;
     int nlocks;
     int locksize;
 };
 
-template <typename Key_t>
-void LinearProbingHash<Key_t>::Insert(Key_t& key, Value_t value){
-    uint64_t key_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	key_hash = h(key, sizeof(Key_t));
-    else
-	key_hash = h(&key, sizeof(Key_t));
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+void LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::Insert(Key_t& key, Value_t value){
+    uint64_t key_hash = KT::hash(key);
 
 RETRY:
-    while(resizing_lock){
-	asm("nop");
-    }
+    wait_resize();
 
     auto loc = key_hash;
-    if(size < capacity*kResizingThreshold){
+    if(size.below(capacity*kResizingThreshold)){
+	auto _dict = dict;
 	int i = 0;
 	while(i < capacity){
 	    auto slot = (loc + i) % capacity;
-	    unique_lock<shared_mutex> lock(mutex[slot/locksize]);
+	    unique_lock<lock_t> lock(mutex[slot/locksize]);
+	    /* the probe must not go on in a resized table, a key behind an empty slot is never found */
+	    if(_dict != dict)
+		goto RETRY;
 	    do{
-		if constexpr(sizeof(Key_t) > 8){
-		    if(memcmp(dict[slot].key, INVALID<Key_t>, sizeof(Key_t)) == 0){
-			memcpy(dict[slot].key, key, sizeof(Key_t));
-			memcpy(&dict[slot].value, &value, sizeof(Value_t));
-			auto _size = size;
-			while(!CAS(&size, &_size, _size+1)){
-			    _size = size;
-			}
-			return;
-		    }
-		}
-		else{
-		    if(memcmp(&dict[slot].key, &INVALID<Key_t>, sizeof(Key_t)) == 0){
-			memcpy(&dict[slot].key, &key, sizeof(Key_t));
-			memcpy(&dict[slot].value, &value, sizeof(Value_t));
-			auto _size = size;
-			while(!CAS(&size, &_size, _size+1)){
-			    _size = size;
-			}
-			return;
-		    }
+		bool empty = KT::empty(dict->key(slot));
+		if(empty || KT::deleted(dict->key(slot))){
+		    KT::copy(dict->key(slot), key);
+		    dict->value(slot) = value;
+		    if(empty)
+			size.add(1);
+		    pairs.add(1);
+		    return;
 		}
 		i++;
 		slot = (loc + i) % capacity;
 		if(!(i < capacity)) break;
 	    }while(slot % locksize != 0);
 	}
-    }else{
-	auto unlocked = 0;
-	if(CAS(&resizing_lock, &unlocked, 1)){
-#ifdef BREAKDOWN
-	    clock_gettime(CLOCK_MONOTONIC, &t_start);
-#endif
-	    resize(capacity * kResizingFactor);
-	    resizing_lock = 0;
-#ifdef BREAKDOWN
-	    clock_gettime(CLOCK_MONOTONIC, &t_end);
-	    split_time += t_end.tv_nsec - t_start.tv_nsec + (t_end.tv_sec - t_start.tv_sec)*1000000000;
-#endif
-	}
-    }
+    }else
+	grow();
     goto RETRY;
 }
 
-template <typename Key_t>
-bool LinearProbingHash<Key_t>::Update(Key_t& key, Value_t value){
-    uint64_t key_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	key_hash = h(key, sizeof(Key_t));
-    else
-	key_hash = h(&key, sizeof(Key_t));
+/* Single probe pass for Upsert/GetOrInsert: returns true if key was inserted, otherwise overwrites
+ * its value with value if assign is set and copies it to value if not.
+ * Every stripe the probe crosses stays locked until the pair is placed, so that no other writer
+ * can put the same key into a slot we have already passed. Stripes are locked in ascending order,
+ * the ones after a wrap-around only with try_lock, which keeps writers and resize() deadlock-free. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::upsert(Key_t& key, Value_t& value, bool assign){
+    uint64_t key_hash = KT::hash(key);
 
 RETRY:
-    while(resizing_lock){
-	asm("nop");
+    wait_resize();
+    if(!size.below(capacity*kResizingThreshold)){
+	grow();
+	goto RETRY;
     }
-    for(int i=0; i<capacity; i++){
-	auto loc = (key_hash + i) % capacity;
-	unique_lock<shared_mutex> lock(mutex[loc/locksize]);
-	if constexpr(sizeof(Key_t) > 8){
-	    if(memcmp(dict[loc].key, key, sizeof(Key_t)) == 0){
-		memcpy(&dict[loc].value, &value, sizeof(Value_t));
-		return true;
-	    }
+
+    auto _capacity = capacity;
+    auto _dict = dict;
+    auto _mutex = mutex;
+    auto home = key_hash % _capacity;
+    size_t first = home / locksize, last = first;  // stripes [first, last] are held
+    size_t wrapped = 0;                            // and so are [0, wrapped) once the probe wrapped around
+    _mutex[first].lock();
+    if(_dict != dict){
+	_mutex[first].unlock();
+	goto RETRY;
+    }
+
+    auto unlock_all = [&](){
+	for(auto s=first; s<=last; s++)
+	    _mutex[s].unlock();
+	for(size_t s=0; s<wrapped; s++)
+	    _mutex[s].unlock();
+    };
+
+    size_t target = _capacity;
+    bool found = false;
+    for(size_t i=0; i<_capacity; i++){
+	auto slot = (home + i) % _capacity;
+	auto s = slot / locksize;
+	if(slot >= home && s > last){
+	    _mutex[s].lock();
+	    last = s;
 	}
-	else{
-	    if(memcmp(&dict[loc].key, &key, sizeof(Key_t)) == 0){
-		memcpy(&dict[loc].value, &value, sizeof(Value_t));
-		return true;
+	else if(slot < home && s >= wrapped && s < first){
+	    if(!_mutex[s].try_lock()){
+		unlock_all();
+		goto RETRY;
 	    }
+	    wrapped = s+1;
+	}
+
+	if(KT::equal(_dict->key(slot), key)){
+	    if(assign)
+		_dict->value(slot) = value;
+	    else
+		value = _dict->value(slot);
+	    found = true;
+	    break;
 	}
+	if(KT::empty(_dict->key(slot))){
+	    if(target == _capacity)
+		target = slot;
+	    break;
+	}
+	if(target == _capacity && KT::deleted(_dict->key(slot)))
+	    target = slot;
     }
-    return false;
+
+    if(!found){
+	if(target == _capacity){
+	    unlock_all();
+	    grow();
+	    goto RETRY;
+	}
+	if(KT::empty(_dict->key(target)))
+	    size.add(1);
+	pairs.add(1);
+	KT::copy(_dict->key(target), key);
+	_dict->value(target) = value;
+    }
+    unlock_all();
+    return !found;
 }
 
-template <typename Key_t>
-bool LinearProbingHash<Key_t>::Delete(Key_t& key){
-    uint64_t key_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	key_hash = h(key, sizeof(Key_t));
-    else
-	key_hash = h(&key, sizeof(Key_t));
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::Update(Key_t& key, Value_t value){
+    uint64_t key_hash = KT::hash(key);
 
 RETRY:
-    while(resizing_lock){
-	asm("nop");
-    }
+    wait_resize();
+    auto _dict = dict;
     for(int i=0; i<capacity; i++){
 	auto loc = (key_hash + i) % capacity;
-	unique_lock<shared_mutex> lock(mutex[loc/locksize]);
-	if constexpr(sizeof(Key_t) > 8){
-	    if(memcmp(dict[loc].key, key, sizeof(Key_t)) == 0){
-		memcpy(dict[loc].key, INVALID<Key_t>, sizeof(Key_t));
-		return true;
-	    }
-	}
-	else{
-	    if(memcmp(&dict[loc].key, &key, sizeof(Key_t)) == 0){
-		memcpy(&dict[loc].key, &INVALID<Key_t>, sizeof(Key_t));
-		return true;
-	    }
+	unique_lock<lock_t> lock(mutex[loc/locksize]);
+	if(_dict != dict)
+	    goto RETRY;
+	if(KT::equal(dict->key(loc), key)){
+	    dict->value(loc) = value;
+	    return true;
 	}
+	if(KT::empty(dict->key(loc)))
+	    break;
     }
     return false;
 }
 
-template <typename Key_t>
-char* LinearProbingHash<Key_t>::Get(Key_t& key){
-    uint64_t key_hash;
-    if constexpr(sizeof(Key_t) > 8)
-	key_hash = h(key, sizeof(Key_t));
-    else
-	key_hash = h(&key, sizeof(Key_t));
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::Delete(Key_t& key){
+    uint64_t key_hash = KT::hash(key);
 
 RETRY:
-    while(resizing_lock){
-	asm("nop");
+    wait_resize();
+    auto _dict = dict;
+    for(int i=0; i<capacity; i++){
+	auto loc = (key_hash + i) % capacity;
+	unique_lock<lock_t> lock(mutex[loc/locksize]);
+	if(_dict != dict)
+	    goto RETRY;
+	if(KT::equal(dict->key(loc), key)){
+	    /* leave a tombstone so that probes for the keys behind it do not stop here */
+	    KT::mark_deleted(dict->key(loc));
+	    pairs.add(-1);
+	    return true;
+	}
+	if(KT::empty(dict->key(loc)))
+	    break;
     }
+    return false;
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+bool LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::Get(Key_t& key, Value_t& value){
+    uint64_t key_hash = KT::hash(key);
+
+RETRY:
+    wait_resize();
+    auto _dict = dict;
     for(int i=0; i<capacity; i++){
 	auto loc = (key_hash + i) % capacity;
-	shared_lock<shared_mutex> lock(mutex[loc/locksize]);
-	if constexpr(sizeof(Key_t) > 8){
-	    if(memcmp(dict[loc].key, key, sizeof(Key_t)) == 0){
-		return (char*)dict[loc].value;
-	    }
+	shared_lock<lock_t> lock(mutex[loc/locksize]);
+	if(_dict != dict)
+	    goto RETRY;
+	if(KT::equal(dict->key(loc), key)){
+	    value = VT::load(dict->value(loc));
+	    return true;
 	}
-	else{
-	    if(memcmp(&dict[loc].key, &key, sizeof(Key_t)) == 0){
-		return (char*)dict[loc].value;
+	if(KT::empty(dict->key(loc)))
+	    break;
+    }
+    return false;
+}
+
+/* Runs fn on the value slot of key (see util/value_traits.h), holding the value_lock of the stripe of
+ * every slot the probe visits. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+template <typename F>
+bool LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::apply(Key_t& key, F&& fn){
+    uint64_t key_hash = KT::hash(key);
+
+RETRY:
+    wait_resize();
+    auto _dict = dict;
+    for(size_t i=0; i<capacity; i++){
+	auto loc = (key_hash + i) % capacity;
+	value_lock<Value_t, lock_t> lock(mutex[loc/locksize]);
+	if(_dict != dict)
+	    goto RETRY;
+	if(KT::equal(dict->key(loc), key))
+	    return fn(&dict->value(loc));
+	if(KT::empty(dict->key(loc)))
+	    break;
+    }
+    return false;
+}
+
+/* Applies op to every pair of the batch, one stripe lock acquisition per stripe.
+ * op(i, slot) is tried on the slots from the home slot of pair i up to the end of its stripe
+ * and returns true once it has been applied; pairs that run off their stripe go through fallback(i). */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+template <typename Op, typename Fallback>
+size_t LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::batch(Pair<Key_t, Value_t>* kv, size_t num, Op&& op, Fallback&& fallback){
+    vector<size_t> key_hash(num);
+    vector<size_t> stripe(num);
+    hash_batch<Key_t, Hasher>(kv, num, kDefaultSeed, key_hash.data());
+
+    wait_resize();
+    auto _capacity = capacity;
+    auto _dict = dict;
+    for(size_t i=0; i<num; i++)
+	stripe[i] = (key_hash[i] % _capacity) / locksize;
+
+    size_t cnt = 0;
+    bool stale = false;
+    vector<uint32_t> leftover;
+    for_each_group(stripe.data(), num, [&](size_t s, const uint32_t* idx, size_t n){
+	    if(!stale){
+		unique_lock<lock_t> lock(mutex[s]);
+		if(_dict == dict){
+		    for(size_t j=0; j<n; j++){
+			auto i = idx[j];
+			bool applied = false;
+			for(auto slot = key_hash[i] % _capacity; slot < _capacity && slot/locksize == s; slot++){
+			    if(op(i, slot)){
+				applied = true;
+				break;
+			    }
+			}
+			if(applied)
+			    cnt++;
+			else
+			    leftover.push_back(i);
+		    }
+		    return;
+		}
+		/* the table has been resized under us, the stripes computed above are useless now */
+		stale = true;
 	    }
-	}
+	    leftover.insert(leftover.end(), idx, idx+n);
+	});
+
+    for(auto i: leftover)
+	cnt += fallback(i);
+    return cnt;
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+void LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::InsertBatch(Pair<Key_t, Value_t>* kv, size_t num){
+    if(!size.below(capacity*kResizingThreshold - num)){
+	/* let the per-key path trigger the resize */
+	for(size_t i=0; i<num; i++)
+	    Insert(kv[i].key, kv[i].value);
+	return;
     }
-    return (char*)NONE;
+
+    size_t inserted = 0, placed = 0;
+    batch(kv, num, [&](size_t i, size_t slot){
+	    bool empty = KT::empty(dict->key(slot));
+	    if(empty || KT::deleted(dict->key(slot))){
+		KT::copy(dict->key(slot), kv[i].key);
+		dict->value(slot) = kv[i].value;
+		inserted += empty;
+		placed++;
+		return true;
+	    }
+	    return false;
+	}, [&](size_t i){
+	    Insert(kv[i].key, kv[i].value);
+	    return true;
+	});
+    size.add(inserted);
+    pairs.add(placed);
+}
+
+/* A pair goes to the first free slot from its home slot on, as with Insert, as long as that slot is in the
+ * range of the thread that owns the home slot; probes running past the end of it are left to Insert. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+void LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::BulkLoad(Pair<Key_t, Value_t>* kv, size_t num, size_t num_threads){
+    reserve(num, num_threads);
+
+    size_t nparts = (capacity + kBulkPartition - 1) / kBulkPartition;
+    vector<uint32_t> order;
+    vector<size_t> bounds;
+    parallel_partition(num, nparts, num_threads, [&](size_t from, size_t n, uint32_t* id){
+	    size_t key_hash[kHashBatch];
+	    for(size_t i=0; i<n; i+=kHashBatch){
+		auto m = std::min(kHashBatch, n - i);
+		hash_batch<Key_t, Hasher>(&kv[from+i], m, kDefaultSeed, key_hash);
+		for(size_t j=0; j<m; j++)
+		    id[i+j] = key_hash[j] % capacity / kBulkPartition;
+	    }
+	}, order, bounds);
+
+    vector<vector<uint32_t>> overflow(num_threads);
+    vector<size_t> inserted(num_threads, 0);
+    parallel_run(num_threads, [&](size_t tid){
+	    size_t first = nparts*tid/num_threads, last = nparts*(tid+1)/num_threads;
+	    size_t end = std::min(last*kBulkPartition, capacity);
+	    for(size_t j=bounds[first]; j<bounds[last]; j++){
+		auto i = order[j];
+		auto slot = KT::hash(kv[i].key) % capacity;
+		while(slot < end && !KT::empty(dict->key(slot)) && !KT::deleted(dict->key(slot)))
+		    slot++;
+		if(slot == end){
+		    overflow[tid].push_back(i);
+		    continue;
+		}
+		inserted[tid] += KT::empty(dict->key(slot));
+		KT::copy(dict->key(slot), kv[i].key);
+		dict->value(slot) = kv[i].value;
+	    }
+	});
+    size_t placed = num;
+    for(size_t t=0; t<num_threads; t++){
+	size.add(inserted[t]);
+	placed -= overflow[t].size();
+    }
+    pairs.add(placed);
+
+    parallel_run(num_threads, [&](size_t tid){
+	    for(auto i: overflow[tid])
+		Insert(kv[i].key, kv[i].value);
+	});
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+size_t LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::UpdateBatch(Pair<Key_t, Value_t>* kv, size_t num){
+    return batch(kv, num, [&](size_t i, size_t slot){
+	    if(KT::equal(dict->key(slot), kv[i].key)){
+		dict->value(slot) = kv[i].value;
+		return true;
+	    }
+	    return false;
+	}, [&](size_t i){
+	    return Update(kv[i].key, kv[i].value);
+	});
 }
 
-template <typename Key_t>
-size_t LinearProbingHash<Key_t>::getLocation(size_t hash_value, size_t _capacity, Pair<Key_t>* _dict){
-    size_t cur = hash_value;
-    int i = 0;
-    if constexpr(sizeof(Key_t) > 8){
-	while(memcmp(_dict[cur].key, INVALID<Key_t>, sizeof(Key_t)) != 0){
-	    cur = (cur+1) % _capacity;
-	    i++;
-	    if(!(i < _capacity))
-		return -1;
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+size_t LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::DeleteBatch(Pair<Key_t, Value_t>* kv, size_t num){
+    return batch(kv, num, [&](size_t i, size_t slot){
+	    if(KT::equal(dict->key(slot), kv[i].key)){
+		KT::mark_deleted(dict->key(slot));
+		pairs.add(-1);
+		return true;
+	    }
+	    return false;
+	}, [&](size_t i){
+	    return Delete(kv[i].key);
+	});
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+task<bool> LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::GetCoro(Key_t& key, Value_t& value){
+    uint64_t key_hash = KT::hash(key);
+
+RETRY:
+    wait_resize();
+    auto _capacity = capacity;
+    auto _dict = dict;
+    uintptr_t line = 0;
+    for(size_t i=0; i<_capacity; i++){
+	auto loc = (key_hash + i) % _capacity;
+	/* suspend only when the probe steps onto a cache line we have not touched yet */
+	auto last = ((uintptr_t)_dict->keys(loc) + table_t::kProbeBytes - 1) >> 6;
+	if(last != line){
+	    co_await prefetch(_dict->keys(loc), table_t::kProbeBytes);
+	    line = last;
+	    if(__atomic_load_n(&resizing_lock, __ATOMIC_SEQ_CST) || _dict != dict)
+		goto RETRY;
+	}
+	shared_lock<lock_t> lock(mutex[loc/locksize]);
+	/* a resize may have been done between the check above and the lock */
+	if(_dict != dict)
+	    goto RETRY;
+	if(KT::equal(_dict->key(loc), key)){
+	    value = VT::load(_dict->value(loc));
+	    co_return true;
 	}
-	return cur;
+	if(KT::empty(_dict->key(loc)))
+	    break;
     }
-    else{
-	while(memcmp(&_dict[cur].key, &INVALID<Key_t>, sizeof(Key_t)) != 0){
-	    cur = (cur+1) % _capacity;
-	    i++;
-	    if(!(i < _capacity))
-		return -1;
+    co_return false;
+}
+
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+template <typename F>
+void LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::ForEach(F&& fn, size_t num_threads){
+    __atomic_fetch_add(&scanners, 1, __ATOMIC_SEQ_CST);
+    wait_resize();
+
+    auto _capacity = capacity;
+    auto _dict = dict;
+    size_t nstripes = (_capacity + locksize - 1) / locksize;
+    parallel_run(num_threads, [&](size_t tid){
+	    vector<Pair<Key_t, Value_t>> buf;
+	    buf.reserve(locksize);
+	    for(size_t s=nstripes*tid/num_threads; s<nstripes*(tid+1)/num_threads; s++){
+		buf.clear();
+		{
+		    shared_lock<lock_t> lock(mutex[s]);
+		    for(size_t i=s*locksize; i<std::min((s+1)*locksize, _capacity); i++){
+			if(!KT::empty(_dict->key(i)) && !KT::deleted(_dict->key(i)))
+			    buf.push_back(_dict->get(i));
+		    }
+		}
+		if(!buf.empty())
+		    fn(buf.data(), buf.size());
+	    }
+	});
+
+    __atomic_fetch_sub(&scanners, 1, __ATOMIC_SEQ_CST);
+}
+
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+void LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::reserve(size_t num, size_t num_threads){
+    auto _capacity = planned(size.sum() + num, load_factor);
+    if(_capacity > capacity)
+	resize(_capacity, num_threads);
+}
+
+/* resizes the table unless another thread is already doing it or a ForEach is running */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+void LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::grow(void){
+    auto unlocked = 0;
+    if(CAS(&resizing_lock, &unlocked, 1)){
+	if(__atomic_load_n(&scanners, __ATOMIC_SEQ_CST)){
+	    end_resize();
+	    return;
 	}
-	return cur;
+#ifdef BREAKDOWN
+	clock_gettime(CLOCK_MONOTONIC, &t_start);
+#endif
+	/* a table filled up mostly by tombstones only needs a rehash at the size its live pairs plan for */
+	auto live = pairs.sum();
+	if(live < capacity * load_factor)
+	    resize(planned(live, load_factor));
+	else
+	    resize(capacity * kResizingFactor);
+	end_resize();
+#ifdef BREAKDOWN
+	clock_gettime(CLOCK_MONOTONIC, &t_end);
+	split_time += t_end.tv_nsec - t_start.tv_nsec + (t_end.tv_sec - t_start.tv_sec)*1000000000;
+#endif
     }
 }
 
-template <typename Key_t>
-void LinearProbingHash<Key_t>::resize(size_t _capacity){
-    unique_lock<shared_mutex>* lock[nlocks];
+/* The old table is rehashed in chunks by the resizing thread, num_threads-1 workers and every thread that
+ * waits for the resize. Chunks go into the new table under its stripe locks; a probe only ever steps over
+ * slots that are already taken, which stay taken, so stripes are locked one at a time. */
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+void LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::resize(size_t _capacity, size_t num_threads){
+    unique_lock<lock_t>* lock[nlocks];
     for(int i=0; i<nlocks; i++){
-	lock[i] = new unique_lock<shared_mutex>(mutex[i]);
+	lock[i] = new unique_lock<lock_t>(mutex[i]);
     }
     int prev_nlocks = nlocks;
     nlocks = _capacity / locksize + 1;
-    shared_mutex* old_mutex = mutex;
+    lock_t* old_mutex = mutex;
+    lock_t* new_mutex = new lock_t[nlocks];
 
-    Pair<Key_t>* new_dict = new Pair<Key_t>[_capacity];
-    for(int i=0; i<capacity; i++){
-	if constexpr(sizeof(Key_t) > 8){
-	    if(memcmp(dict[i].key, INVALID<Key_t>, sizeof(Key_t)) != 0){
-		auto key_hash = h(dict[i].key, sizeof(Key_t)) % _capacity;
-		auto loc = getLocation(key_hash, _capacity, new_dict);
-		memcpy(&new_dict[loc], &dict[i], sizeof(Pair<Key_t>));
-	    }
-	}
-	else{
-	    if(memcmp(&dict[i].key, &INVALID<Key_t>, sizeof(Key_t)) != 0){
-		auto key_hash = h(&dict[i].key, sizeof(Key_t)) % _capacity;
-		auto loc = getLocation(key_hash, _capacity, new_dict);
-		memcpy(&new_dict[loc], &dict[i], sizeof(Pair<Key_t>));
+    table_t* new_dict = new table_t(_capacity);
+    size_t live = 0;
+    rehash.run((capacity + kRehashChunk - 1) / kRehashChunk, num_threads, [&](size_t chunk){
+	    size_t key_hash[kHashBatch];
+	    size_t cnt = 0;
+	    size_t end = std::min((chunk+1)*kRehashChunk, capacity);
+	    for(size_t from=chunk*kRehashChunk; from<end; from+=kHashBatch){
+		auto n = std::min(kHashBatch, end - from);
+		hash_batch<Key_t, Hasher>(dict->keys(from), table_t::kStride, n, kDefaultSeed, key_hash);
+		for(size_t j=0; j<n; j++){
+		    /* tombstones are not carried over */
+		    if(KT::empty(dict->key(from+j)) || KT::deleted(dict->key(from+j)))
+			continue;
+		    auto slot = key_hash[j] % _capacity;
+		    bool placed = false;
+		    while(!placed){
+			unique_lock<lock_t> stripe(new_mutex[slot/locksize]);
+			do{
+			    if(KT::empty(new_dict->key(slot))){
+				new_dict->set(slot, dict->get(from+j));
+				placed = true;
+				break;
+			    }
+			    slot = (slot+1) % _capacity;
+			}while(slot % locksize != 0);
+		    }
+		    cnt++;
+		}
 	    }
-	}
-    }
-    mutex = new shared_mutex[nlocks];
-    old_cap = capacity;
-    old_dic = dict;
+	    __atomic_fetch_add(&live, cnt, __ATOMIC_RELAXED);
+	});
+    retired.emplace_back(old_mutex, dict);
+    mutex = new_mutex;
     capacity = _capacity;
     dict = new_dict;
-    auto tmp = old_dic;
-    old_cap = 0;
-    old_dic = nullptr;
+    size.set(live);
+    pairs.set(live);
     for(int i=0; i<prev_nlocks; i++){
 	delete lock[i];
     }
-    delete[] old_mutex;
-    //delete[] tmp;
 }
 
-template <typename Key_t>
-void LinearProbingHash<Key_t>::FindAnyway(Key_t& key){
+template <typename Key_t, typename Value_t, typename Hasher, typename Layout, typename Lock>
+void LinearProbingHash<Key_t, Value_t, Hasher, Layout, Lock>::FindAnyway(Key_t& key){
 	for(int i=0; i<capacity; i++){
-		if constexpr(sizeof(Key_t) > 8){
-			if(memcmp(dict[i].key, key, sizeof(Key_t)) == 0){
-				//cout << "FOUND: " << dict[i].key << "\t" << key << endl;
-				return;
-			}
-		}
-		else{
-			if(memcmp(&dict[i].key, &key, sizeof(Key_t)) == 0){
-				//cout << "FOUND: " << dict[i].key << "\t" << key << endl;
-				return;
-			}
+		if(KT::equal(dict->key(i), key)){
+			//cout << "FOUND: " << dict->key(i) << "\t" << key << endl;
+			return;
 		}
 	}
 	cout << "NOT FOUND for key " << key << endl;
@@ -0,0 +1,140 @@
+#include <iostream>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include "util/hash.h"
+#include "util/key_traits.h"
+#include "util/hash_batch.h"
+#include "util/pair.h"
+#include "util/timer.h"
+
+/* Hash function microbenchmark.
+ * For every hash policy and key distribution it reports
+ *  - ns/hash: average hashing cost over the whole key set,
+ *  - batch:   the same through hash_batch (SIMD lanes where util/hash_batch.h has them),
+ *  - probe:   mean/max probe length of a linear probing table filled to kLoad (low bits, modulo),
+ *  - skew:    fullest/average bucket when keys are bucketed by the top bits of the hash,
+ *             the way the extendible hashing directory picks a segment,
+ *  - dup:     number of keys whose 64-bit hash collides with another key. */
+
+const double kLoad = 0.8;
+const size_t kKeysPerBucket = 1024;
+size_t sink = 0;
+
+template <typename Key_t, typename Hasher>
+void measure(const char* hasher, const char* dist, Pair<Key_t>* keys, size_t num){
+    using KT = KeyTraits<Key_t, Hasher>;
+    std::vector<size_t> hashes(num);
+    Timer timer;
+
+    /* repeat small key sets so that the timed region is not dominated by timer overhead */
+    size_t rounds = std::max((size_t)1, (size_t)(1 << 24) / num);
+    timer.start();
+    for(size_t r=0; r<rounds; r++){
+	for(size_t i=0; i<num; i++)
+	    sink += KT::hash(keys[i].key);
+    }
+    timer.end();
+    double ns = (double)timer.get_time() / (rounds * num);
+
+    timer.start();
+    for(size_t r=0; r<rounds; r++){
+	hash_batch<Key_t, Hasher>(keys, num, kDefaultSeed, hashes.data());
+	sink += hashes[r % num];
+    }
+    timer.end();
+    double batch_ns = (double)timer.get_time() / (rounds * num);
+
+    for(size_t i=0; i<num; i++){
+	if(hashes[i] != KT::hash(keys[i].key)){
+	    fprintf(stderr, "%s %s: hash_batch differs from the scalar hash at key %zu\n", hasher, dist, i);
+	    exit(1);
+	}
+    }
+
+    size_t capacity = num / kLoad;
+    std::vector<bool> used(capacity, false);
+    size_t probe_sum = 0, probe_max = 0;
+    for(size_t i=0; i<num; i++){
+	size_t loc = hashes[i] % capacity;
+	size_t probe = 1;
+	while(used[loc]){
+	    loc = (loc + 1) % capacity;
+	    probe++;
+	}
+	used[loc] = true;
+	probe_sum += probe;
+	probe_max = std::max(probe_max, probe);
+    }
+
+    size_t depth = 0;
+    while(((size_t)1 << (depth+1)) * kKeysPerBucket <= num)
+	depth++;
+    std::vector<size_t> bucket((size_t)1 << depth, 0);
+    for(size_t i=0; i<num; i++)
+	bucket[depth ? hashes[i] >> (64 - depth) : 0]++;
+    double skew = (double)*std::max_element(bucket.begin(), bucket.end()) / ((double)num / bucket.size());
+
+    std::sort(hashes.begin(), hashes.end());
+    size_t dup = 0;
+    for(size_t i=1; i<num; i++){
+	if(hashes[i] == hashes[i-1])
+	    dup++;
+    }
+
+    printf("%-10s %-12s %8.2f %8.2f %8.2f %8zu %8.2f %8zu\n", hasher, dist, ns, batch_ns, (double)probe_sum / num, probe_max, skew, dup);
+}
+
+template <typename Key_t>
+void run(const char* dist, Pair<Key_t>* keys, size_t num){
+    measure<Key_t, std_hash>("std", dist, keys, num);
+    measure<Key_t, murmur2_hash>("murmur2", dist, keys, num);
+    measure<Key_t, jenkins_hash>("jenkins", dist, keys, num);
+    measure<Key_t, xx_hash>("xxhash", dist, keys, num);
+    measure<Key_t, crc32c_hash>("crc32c", dist, keys, num);
+    measure<Key_t, wy_hash>("wyhash", dist, keys, num);
+    measure<Key_t, mulshift_hash>("mulshift", dist, keys, num);
+}
+
+int main(int argc, char* argv[]){
+    if(argc < 2){
+	std::cerr << "Usage: " << argv[0] << " num_keys" << std::endl;
+	exit(0);
+    }
+    size_t num = atol(argv[1]);
+    std::mt19937_64 rng(1729);
+
+    printf("%-10s %-12s %8s %8s %8s %8s %8s %8s\n", "hash", "keys", "ns/hash", "batch", "probe", "max", "skew", "dup");
+
+    auto ints = new Pair<int64_t>[num];
+    gen_input<int64_t>(ints, num);
+    run<int64_t>("int_seq", ints, num);
+    for(size_t i=0; i<num; i++)
+	ints[i].key = rng();
+    run<int64_t>("int_rand", ints, num);
+    /* keys that only differ in their high bits */
+    for(size_t i=0; i<num; i++)
+	ints[i].key = (int64_t)(i+1) << 32;
+    run<int64_t>("int_stride", ints, num);
+    delete[] ints;
+
+    using Key = char[32];
+    auto strs = new Pair<Key>[num];
+    gen_input<Key>(strs, num);
+    run<Key>("str_rand", strs, num);
+    /* long shared prefix followed by a counter, as produced by the YCSB key generator */
+    for(size_t i=0; i<num; i++){
+	uint64_t id = i+1;
+	memset(strs[i].key, 1, sizeof(Key));
+	memcpy(&strs[i].key[sizeof(Key) - sizeof(id)], &id, sizeof(id));
+    }
+    run<Key>("str_prefix", strs, num);
+    delete[] strs;
+
+    if(sink == 0)
+	std::cout << std::endl;
+    return 0;
+}
@@ -2,6 +2,8 @@
 #include "index/linear_probing.h"
 #elif defined EXT
 #include "index/extendible_hash.h"
+#elif defined BTREE
+#include "index/btree_olc.h"
 #else
 #include "index/cuckoo_hash.h"
 #endif
@@ -44,18 +46,26 @@ void generate_string_workloads(char* arr, int num){
 	}
 }
 
-int main(int argc, char* argv[]){
-    const size_t initialTableSize = 1024 * 16;
-    int numData = atoi(argv[1]);
-    int numThreads = atoi(argv[2]);
-    struct Pair<Key>* input = new struct Pair<Key>[numData];
+Hash<Key>* new_index(void){
 #ifdef LIN
-    Hash<Key>* hashtable = new LinearProbingHash<Key>(initialTableSize);
+    const size_t initialTableSize = 1024 * 16;
+    return new LinearProbingHash<Key>(initialTableSize);
 #elif defined EXT
-    Hash<Key>* hashtable = new ExtendibleHash<Key>(initialTableSize/Segment<Key>::kNumSlot);
+    const size_t initialTableSize = 1024 * 16;
+    return new ExtendibleHash<Key>(initialTableSize/Segment<Key>::kNumSlot);
+#elif defined BTREE
+    return new BTreeOLC<Key>();
 #else
-    Hash<Key>* hashtable = new CuckooHash<Key>(initialTableSize);
+    const size_t initialTableSize = 1024 * 16;
+    return new CuckooHash<Key>(initialTableSize);
 #endif
+}
+
+int main(int argc, char* argv[]){
+    int numData = atoi(argv[1]);
+    int numThreads = atoi(argv[2]);
+    struct Pair<Key>* input = new struct Pair<Key>[numData];
+    Hash<Key>* hashtable = new_index();
 
     invalid_initialize<Key>();
     if constexpr(sizeof(Key) > 8)
@@ -76,8 +86,8 @@ int main(int argc, char* argv[]){
     auto search = [&hashtable, &input, &fail](int from, int to, int tid){
 	int failed = 0;
 	for(int i=from; i<to; i++){
-	    auto ret = hashtable->Get(input[i].key);
-	    if((Value_t)ret != input[i].value){
+	    default_value v;
+	    if(!hashtable->Get(input[i].key, v) || !(v == input[i].value)){
 		failed++;
 	    }
 	}
@@ -105,5 +115,100 @@ int main(int argc, char* argv[]){
     for(auto& it: fail) failedSearch += it;
     std::cout << "failedSearhc: " << failedSearch << std::endl;
 
+    /* readers against a writer that keeps growing a fresh index: every key published so far must be found */
+    const int numReaders = 3;
+    Hash<Key>* growing = new_index();
+    int published = 0;
+    vector<thread> readers;
+    vector<int> wrong(numReaders);
+    for(int t=0; t<numReaders; t++){
+	readers.emplace_back([&, t](){
+		std::mt19937 gen(t);
+		int failed = 0;
+		for(int n; (n = __atomic_load_n(&published, __ATOMIC_ACQUIRE)) < numData; ){
+		    if(n == 0)
+			continue;
+		    int i = gen() % n;
+		    default_value v;
+		    if(!growing->Get(input[i].key, v) || !(v == input[i].value))
+			failed++;
+		}
+		wrong[t] = failed;
+	    });
+    }
+    for(int i=0; i<numData; i++){
+	growing->Insert(input[i].key, input[i].value);
+	__atomic_store_n(&published, i+1, __ATOMIC_RELEASE);
+    }
+    for(auto& t: readers) t.join();
+
+    int failedConcurrentSearch = 0;
+    for(auto& it: wrong) failedConcurrentSearch += it;
+    std::cout << "failedConcurrentSearch: " << failedConcurrentSearch << std::endl;
+    delete growing;
+
+#ifdef BTREE
+    /* scans against threads inserting and deleting other keys: every pass over the tree must return all
+     * pairs of the first phase, in key order */
+    using KT = KeyTraits<Key>;
+    auto tree = dynamic_cast<OrderedIndex<Key>*>(hashtable);
+    const int numWriters = 3;
+    const int numChurn = numData / 4;
+    const int numPasses = 3;
+    const size_t scanLength = 100;
+    struct Pair<Key>* churn = new struct Pair<Key>[numChurn];
+    generate_string_workloads<Key>((char*)churn, numChurn);
+    std::sort(input, input+numData, [](const Pair<Key>& a, const Pair<Key>& b){ return KT::compare(a.key, b.key) < 0; });
+
+    bool stop = false;
+    vector<thread> writers;
+    for(int t=0; t<numWriters; t++){
+	writers.emplace_back([&, t](){
+		while(!__atomic_load_n(&stop, __ATOMIC_ACQUIRE)){
+		    for(int i=t; i<numChurn; i+=numWriters)
+			hashtable->Insert(churn[i].key, churn[i].value);
+		    for(int i=t; i<numChurn; i+=numWriters)
+			hashtable->Delete(churn[i].key);
+		}
+	    });
+    }
+
+    int failedScan = 0;
+    size_t scans = 0;
+    vector<Pair<Key>> out(scanLength);
+    for(int pass=0; pass<numPasses; pass++){
+	Key cursor = {};
+	bool started = false;
+	int next = 0;  // first pair of the first phase this pass has not returned yet
+	while(true){
+	    auto n = tree->Scan(cursor, scanLength, out.data());
+	    scans++;
+	    /* a scan starts at the last key of the one before */
+	    size_t i = (started && n > 0 && KT::compare(out[0].key, cursor) == 0) ? 1 : 0;
+	    if(n <= i)
+		break;
+	    for(; i<n; i++){
+		if(started && KT::compare(out[i].key, cursor) <= 0)
+		    failedScan++;
+		while(next < numData && KT::compare(input[next].key, out[i].key) < 0){
+		    failedScan++;
+		    next++;
+		}
+		if(next < numData && KT::compare(input[next].key, out[i].key) == 0){
+		    if(!(out[i].value == input[next].value))
+			failedScan++;
+		    next++;
+		}
+		KT::copy(cursor, out[i].key);
+		started = true;
+	    }
+	}
+	failedScan += numData - next;
+    }
+    __atomic_store_n(&stop, true, __ATOMIC_RELEASE);
+    for(auto& t: writers) t.join();
+    std::cout << "failedScan: " << failedScan << " (" << scans << " scans)" << std::endl;
+#endif
+
     return 0;
 }
@@ -7,21 +7,40 @@
 
 using Key_t = uint64_t;
 extern bool hyperthreading;
+extern bool pinning;
 
 static bool pcm_enabled = false;
 static bool memory_bandwidth = false;
 static bool numa = false;
+static bool presize = false;
+static bool virtual_dispatch = false;
+static bool hot_cache = false;
+static bool bloom = false;
+static int oversub = 0;  // threads per core, 0 to take numThreads
+#ifdef MICROBENCH
 static bool insert_only = false;
+static int miss_ratio = 0;
+#else
+static size_t batch_size = 1;
+static bool bulk_load = false;
+static bool freeze = false;
+#endif
 
 int main(int argc, char* argv[]){
 #ifdef MICROBENCH 
     if(argc < 2){
 	std::cout << "Usage: " << std::endl;
-	std::cout << "1. index type: ext, cuc, lin" << std::endl;
+	std::cout << "1. index type: ext, cuc, lin, btree" << std::endl;
 	std::cout << "2. numData" << std::endl;
 	std::cout << "3. numThreads" << std::endl;
-	std::cout << "4. runmode: 1(microbench), 2(latency) 3(mixed) 4(util)" << std::endl;
+	std::cout << "4. runmode: 1(microbench), 2(latency) 3(mixed) 4(util) 5(interleave) 6(scan) 7(cuckoo filter, index type ignored) 8(clock cache on a zipfian stream, index type ignored)" << std::endl;
 	std::cout << "5. insert-only" << std::endl;
+	std::cout << "   --virtual: call the index through the Hash interface instead of the concrete engine" << std::endl;
+	std::cout << "   --presize: Reserve room for numData pairs before the microbench load" << std::endl;
+	std::cout << "   --miss-ratio=P: P% of the microbench searches look for keys that are not there" << std::endl;
+	std::cout << "   --oversub=K: run K threads per core (overrides numThreads), unpinned" << std::endl;
+	std::cout << "   --hotcache: read through a per-thread cache of hot keys and report its hit rate" << std::endl;
+	std::cout << "   --bloom: put a blocked Bloom filter in front of the index to answer misses" << std::endl;
 	return 1;
     }
 
@@ -32,6 +51,8 @@ int main(int argc, char* argv[]){
 	index_type = TYPE_CUCKOO_HASH;
     else if(strcmp(argv[1], "lin") == 0)
 	index_type = TYPE_LINEAR_HASH;
+    else if(strcmp(argv[1], "btree") == 0)
+	index_type = TYPE_BTREE;
     else{
 	fprintf(stderr, "unkown index type %s\n", argv[2]);
 	return 1;
@@ -40,11 +61,34 @@ int main(int argc, char* argv[]){
     int init_num = atoi(argv[2]);
     int num_threads = atoi(argv[3]);
     int mode = atoi(argv[4]);
-    if(argc > 5){
-    	int insert_only_ = atoi(argv[5]);
-    	if(insert_only_ > 0) insert_only = true;
+    for(int i=5; i<argc; i++){
+	if(strcmp(argv[i], "--virtual") == 0)
+	    virtual_dispatch = true;
+	else if(strcmp(argv[i], "--presize") == 0)
+	    presize = true;
+	else if(strncmp(argv[i], "--oversub=", 10) == 0)
+	    oversub = atoi(argv[i] + 10);
+	else if(strcmp(argv[i], "--hotcache") == 0)
+	    hot_cache = true;
+	else if(strcmp(argv[i], "--bloom") == 0)
+	    bloom = true;
+	else if(strncmp(argv[i], "--miss-ratio=", 13) == 0)
+	    miss_ratio = atoi(argv[i] + 13);
+	else if(atoi(argv[i]) > 0)
+	    insert_only = true;
+    }
+    if(oversub > 0){
+	/* more threads than cores: resize and directory waiters must not starve the thread they wait for */
+	num_threads = oversub * std::thread::hardware_concurrency();
+	pinning = false;
+	std::cout << "oversubscribed: " << num_threads << " threads on " << std::thread::hardware_concurrency() << " cores" << std::endl;
     }
     benchmark_t<Key_t>* bench = new benchmark_t<Key_t>(pcm_enabled);
+    bench->virtual_dispatch = virtual_dispatch;
+    bench->hot_cache = hot_cache;
+    bench->bloom_keys = bloom ? init_num : 0;
+    bench->miss_ratio = miss_ratio;
+    bench->presize = presize;
 
     Pair<Key_t>* init_kv = new Pair<Key_t>[init_num];
     if(mode == 1)
@@ -53,6 +97,14 @@ int main(int argc, char* argv[]){
 	bench->latency(index_type, init_kv, init_num, num_threads);
     else if(mode == 3)
 	bench->mixed(index_type, init_kv, init_num, num_threads);
+    else if(mode == 5)
+	bench->interleave(index_type, init_kv, init_num, num_threads);
+    else if(mode == 6)
+	bench->scan(index_type, init_kv, init_num, num_threads);
+    else if(mode == 7)
+	bench->filter(init_kv, init_num, num_threads);
+    else if(mode == 8)
+	bench->cache(init_kv, init_num, num_threads);
     else
 	bench->utilization(index_type, init_kv, init_num);
     return 0;
@@ -61,13 +113,21 @@ int main(int argc, char* argv[]){
 
     if(argc < 4){
 	std::cout << "Usage: " << std::endl;
-	std::cout << "1. workload type: a, b, c, d" << std::endl;
-	std::cout << "2. index type: ext, cuc, lin" << std::endl;
+	std::cout << "1. workload type: a, b, c, d, e, f" << std::endl;
+	std::cout << "2. index type: ext, cuc, lin, btree" << std::endl;
 	std::cout << "3. number of threads" << std::endl;
 	std::cout << "   --hyper: whether to pin all threads on single NUMA node" << std::endl;
 	std::cout << "   --pcm: whether to use pcm to monitor memory patterns" << std::endl;
 	std::cout << "   --mem: whether to monitor memory access" << std::endl;
 	std::cout << "   --numa: whether to monitor NUMA throughput" << std::endl;
+	std::cout << "   --batch=N: load with InsertBatch in batches of N" << std::endl;
+	std::cout << "   --bulk: load with BulkLoad" << std::endl;
+	std::cout << "   --presize: Reserve room for the load up front instead of growing from the initial size" << std::endl;
+	std::cout << "   --virtual: call the index through the Hash interface instead of the concrete engine" << std::endl;
+	std::cout << "   --oversub=K: run K threads per core (overrides numThreads), unpinned" << std::endl;
+	std::cout << "   --hotcache: read through a per-thread cache of hot keys and report its hit rate" << std::endl;
+	std::cout << "   --bloom: put a blocked Bloom filter in front of the index to answer misses" << std::endl;
+	std::cout << "   --freeze: run workload c on a frozen, minimal perfect hash indexed copy of the loaded index" << std::endl;
 	return 1;
     }
 
@@ -80,6 +140,10 @@ int main(int argc, char* argv[]){
 	workload_type = WORKLOAD_C;
     else if(strcmp(argv[1], "d") == 0)
 	workload_type = WORKLOAD_D;
+    else if(strcmp(argv[1], "e") == 0)
+	workload_type = WORKLOAD_E;
+    else if(strcmp(argv[1], "f") == 0)
+	workload_type = WORKLOAD_F;
     else{
 	fprintf(stderr, "unknown workload type %s\n", argv[1]);
 	return 1;
@@ -92,6 +156,8 @@ int main(int argc, char* argv[]){
 	index_type = TYPE_CUCKOO_HASH;
     else if(strcmp(argv[2], "lin") == 0)
 	index_type = TYPE_LINEAR_HASH;
+    else if(strcmp(argv[2], "btree") == 0)
+	index_type = TYPE_BTREE;
     else{
 	fprintf(stderr, "unkown index type %s\n", argv[2]);
 	return 1;
@@ -113,12 +179,35 @@ int main(int argc, char* argv[]){
 	    memory_bandwidth = true;
 	else if(strcmp(*v, "--numa") == 0)
 	    numa = true;
+	else if(strncmp(*v, "--batch=", 8) == 0)
+	    batch_size = atoi(*v + 8);
+	else if(strcmp(*v, "--bulk") == 0)
+	    bulk_load = true;
+	else if(strcmp(*v, "--presize") == 0)
+	    presize = true;
+	else if(strcmp(*v, "--virtual") == 0)
+	    virtual_dispatch = true;
+	else if(strncmp(*v, "--oversub=", 10) == 0)
+	    oversub = atoi(*v + 10);
+	else if(strcmp(*v, "--hotcache") == 0)
+	    hot_cache = true;
+	else if(strcmp(*v, "--bloom") == 0)
+	    bloom = true;
+	else if(strcmp(*v, "--freeze") == 0)
+	    freeze = true;
 	else{
 	    fprintf(stderr, "unkown option: %s\n", *v);
 	    return 1;
 	}
     }
 
+    if(oversub > 0){
+	/* more threads than cores: resize and directory waiters must not starve the thread they wait for */
+	num_threads = oversub * std::thread::hardware_concurrency();
+	pinning = false;
+	std::cout << "oversubscribed: " << num_threads << " threads on " << std::thread::hardware_concurrency() << " cores" << std::endl;
+    }
+
     /*
     if(memory_bandwidth){
 	if(geteuid() != 0){
@@ -145,6 +234,13 @@ int main(int argc, char* argv[]){
     Pair<Key_t>* init_kv = new Pair<Key_t>[init_num];
     Pair<Key_t>* run_kv = new Pair<Key_t>[run_num];
     int* ops = new int[run_num];
+    bench->batch_size = batch_size;
+    bench->bulk_load = bulk_load;
+    bench->presize = presize;
+    bench->virtual_dispatch = virtual_dispatch;
+    bench->hot_cache = hot_cache;
+    bench->bloom_keys = bloom ? init_num : 0;
+    bench->freeze = freeze;
 
     bench->ycsb_load(workload_type, index_type, init_kv, init_num, run_kv, run_num, ops);
     bench->ycsb_exec(workload_type, index_type, init_kv, init_num, run_kv, run_num, num_threads, ops, pcm_enabled);
@@ -0,0 +1,32 @@
+#ifndef UTIL_BATCH_H_
+#define UTIL_BATCH_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <algorithm>
+
+/* Batched write helpers.
+ * Operations of a batch are bucketed by the lock (stripe or segment) that protects their home slot,
+ * so that every group is applied under one lock acquisition. Groups are visited in ascending
+ * lock order, which is also the order resize() acquires stripe locks in. */
+template <typename F>
+void for_each_group(const size_t* group, size_t num, F&& fn){
+    std::vector<uint32_t> order(num);
+    for(size_t i=0; i<num; i++)
+	order[i] = i;
+    std::sort(order.begin(), order.end(), [group](uint32_t a, uint32_t b){
+	    return group[a] < group[b];
+	    });
+
+    size_t from = 0;
+    while(from < num){
+	size_t to = from + 1;
+	while(to < num && group[order[to]] == group[order[from]])
+	    to++;
+	fn(group[order[from]], &order[from], to - from);
+	from = to;
+    }
+}
+
+#endif  // UTIL_BATCH_H_
@@ -6,32 +6,40 @@
 #include <iostream>
 #include <cstdio>
 #include <cstdlib>
+#include <variant>
 
 #include "index/cuckoo_hash.h"
 #include "index/linear_probing.h"
 #include "index/extendible_hash.h"
+#include "index/btree_olc.h"
 using keytype = uint64_t;
 
 bool hyperthreading = true;
+bool pinning = true;  // --oversub runs more threads than cores and leaves them to the scheduler
 
 enum{
     TYPE_EXTENDIBLE_HASH,
     TYPE_LINEAR_HASH,
-    TYPE_CUCKOO_HASH
+    TYPE_CUCKOO_HASH,
+    TYPE_BTREE
 };
 
 enum{
     OP_INSERT,
     OP_READ,
     OP_UPDATE,
-    OP_DELETE
+    OP_DELETE,
+    OP_RMW,
+    OP_SCAN
 };
 
 enum{
     WORKLOAD_A,
     WORKLOAD_B,
     WORKLOAD_C,
-    WORKLOAD_D
+    WORKLOAD_D,
+    WORKLOAD_E,
+    WORKLOAD_F
 };
 
 enum{
@@ -86,11 +94,32 @@ Hash<Key_t>* getInstance(const int index_type){
 	return new LinearProbingHash<Key_t>(initialTableSize);
     else if(index_type == TYPE_CUCKOO_HASH)
 	return new CuckooHash<Key_t>(initialTableSize);
+    else if(index_type == TYPE_BTREE)
+	return new BTreeOLC<Key_t>();
     else
 	fprintf(stderr, "unkown index type %d\n", index_type);
     return nullptr;
 }
 
+/* the engine behind index_type as its concrete type, for code that wants to be instantiated per engine */
+template <typename Key_t>
+using engine_t = std::variant<ExtendibleHash<Key_t>*, LinearProbingHash<Key_t>*, CuckooHash<Key_t>*, BTreeOLC<Key_t>*>;
+
+template <typename Key_t>
+engine_t<Key_t> getEngine(const int index_type){
+    const size_t initialTableSize = 1024*16;
+    if(index_type == TYPE_EXTENDIBLE_HASH)
+	return new ExtendibleHash<Key_t>(initialTableSize/Segment<Key_t>::kNumSlot);
+    else if(index_type == TYPE_LINEAR_HASH)
+	return new LinearProbingHash<Key_t>(initialTableSize);
+    else if(index_type == TYPE_CUCKOO_HASH)
+	return new CuckooHash<Key_t>(initialTableSize);
+    else if(index_type == TYPE_BTREE)
+	return new BTreeOLC<Key_t>();
+    fprintf(stderr, "unkown index type %d\n", index_type);
+    exit(1);
+}
+
 inline void clear_cache(void){
 #ifndef DEBUG
     int* dummy = new int[1024*1024*256];
@@ -151,7 +180,8 @@ void start_threads(Hash<Key_t> *hash_p, uint64_t num_threads, Fn &&fn, Args &&..
     std::vector<std::thread> thread_group;
 
     auto fn2 = [hash_p, &fn](uint64_t thread_id, Args ...args) {
-	pin_core(thread_id);
+	if(pinning)
+	    pin_core(thread_id);
 	fn(thread_id, args...);
 	return;
     };
@@ -0,0 +1,156 @@
+#ifndef UTIL_COROUTINE_H_
+#define UTIL_COROUTINE_H_
+
+#include <coroutine>
+#include <cstdint>
+#include <cstdlib>
+#include <exception>
+#include <new>
+#include <vector>
+
+/* Coroutine-based lookup interleaving.
+ * A lookup written as a task co_awaits prefetch(addr) right before it touches a cache line
+ * that is likely to miss. The scheduler below keeps several lookups in flight per thread and
+ * switches to the next one on every suspension, so the memory latency of one probe is
+ * overlapped with the work of the others (Psaropoulos et al., "Interleaving with Coroutines"). */
+
+/* coroutine frames are allocated and freed once per lookup; keep them in a per-thread
+ * free list bucketed by cache line multiples instead of going through malloc every time */
+struct frame_pool{
+    static const size_t kLine = 64;
+    static const size_t kNumClass = 16;
+
+    static void* allocate(size_t size){
+	size_t cls = (size + kLine - 1) / kLine;
+	if(cls < kNumClass && head()[cls]){
+	    void* p = head()[cls];
+	    head()[cls] = *(void**)p;
+	    return p;
+	}
+	return ::operator new(cls < kNumClass ? cls * kLine : size);
+    }
+
+    static void release(void* p, size_t size){
+	size_t cls = (size + kLine - 1) / kLine;
+	if(cls < kNumClass){
+	    *(void**)p = head()[cls];
+	    head()[cls] = p;
+	    return;
+	}
+	::operator delete(p);
+    }
+
+    static void** head(void){
+	static thread_local void* _[kNumClass] = {nullptr, };
+	return _;
+    }
+};
+
+template <typename T>
+class task{
+    public:
+	struct promise_type{
+	    T value;
+
+	    task get_return_object(void){
+		return task(std::coroutine_handle<promise_type>::from_promise(*this));
+	    }
+	    /* lazily started: the scheduler decides when a lookup issues its first probe */
+	    std::suspend_always initial_suspend(void) noexcept { return {}; }
+	    std::suspend_always final_suspend(void) noexcept { return {}; }
+	    void return_value(T v){ value = v; }
+	    void unhandled_exception(void){ std::terminate(); }
+
+	    static void* operator new(size_t size){ return frame_pool::allocate(size); }
+	    static void operator delete(void* p, size_t size){ frame_pool::release(p, size); }
+	};
+
+	task(void): handle(nullptr){ }
+	explicit task(std::coroutine_handle<promise_type> h): handle(h){ }
+	task(task&& other): handle(other.handle){ other.handle = nullptr; }
+	task& operator=(task&& other){
+	    if(this != &other){
+		if(handle) handle.destroy();
+		handle = other.handle;
+		other.handle = nullptr;
+	    }
+	    return *this;
+	}
+	task(const task&) = delete;
+	task& operator=(const task&) = delete;
+	~task(void){
+	    if(handle) handle.destroy();
+	}
+
+	bool valid(void) const { return handle != nullptr; }
+	bool done(void) const { return handle.done(); }
+	void resume(void){ handle.resume(); }
+	T result(void) const { return handle.promise().value; }
+
+	/* drive the task to completion on the calling thread without interleaving */
+	T get(void){
+	    while(!handle.done())
+		handle.resume();
+	    return handle.promise().value;
+	}
+
+    private:
+	std::coroutine_handle<promise_type> handle;
+};
+
+/* issue a prefetch for the cache line(s) of [addr, addr+len) and yield to the scheduler */
+struct prefetch{
+    const char* addr;
+    size_t len;
+
+    prefetch(const void* _addr, size_t _len = 1): addr((const char*)_addr), len(_len){ }
+
+    bool await_ready(void) const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<>) const noexcept {
+	uintptr_t first = (uintptr_t)addr & ~(uintptr_t)63;
+	uintptr_t last = ((uintptr_t)addr + len - 1) & ~(uintptr_t)63;
+	for(uintptr_t line=first; line<=last; line+=64)
+	    __builtin_prefetch((const void*)line, 0, 3);
+    }
+    void await_resume(void) const noexcept { }
+};
+
+/* Run lookups [0, num) with at most depth of them in flight.
+ * make(i) returns the (not yet started) task for the i-th lookup,
+ * done(i, result) is called as soon as the i-th lookup completes. */
+template <typename T, typename Make, typename Done>
+void interleave(size_t num, size_t depth, Make&& make, Done&& done){
+    if(depth < 1) depth = 1;
+    std::vector<task<T>> slots(depth);
+    std::vector<size_t> ids(depth);
+    size_t next = 0;
+    size_t inflight = 0;
+
+    for(size_t s=0; s<depth && next<num; s++){
+	slots[s] = make(next);
+	ids[s] = next++;
+	inflight++;
+    }
+
+    while(inflight){
+	for(size_t s=0; s<depth; s++){
+	    auto& t = slots[s];
+	    if(!t.valid())
+		continue;
+	    t.resume();
+	    if(t.done()){
+		done(ids[s], t.result());
+		if(next < num){
+		    t = make(next);
+		    ids[s] = next++;
+		}
+		else{
+		    t = task<T>();
+		    inflight--;
+		}
+	    }
+	}
+    }
+}
+
+#endif  // UTIL_COROUTINE_H_
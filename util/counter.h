@@ -0,0 +1,69 @@
+#ifndef UTIL_COUNTER_H_
+#define UTIL_COUNTER_H_
+
+#include <cstddef>
+#include <cstdint>
+
+/* Size counter for the engines, updated on every insert and delete.
+ * Every thread adds to its own cache-line padded shard and moves the shard into the global count
+ * once it has drifted by kBatch, so writers never share a line except for that flush.
+ * approx() reads only the global count and is off by at most kError; sum() adds up the shards
+ * as well and is exact whenever no update is in flight. */
+class sharded_counter{
+  public:
+    static const size_t kShards = 64;
+    static const int64_t kBatch = 16;
+    static const int64_t kError = kShards * kBatch;
+
+    void add(int64_t delta){
+	auto& shard = shards[slot()].n;
+	auto n = __atomic_add_fetch(&shard, delta, __ATOMIC_RELAXED);
+	if(n >= kBatch || n <= -kBatch){
+	    n = __atomic_exchange_n(&shard, 0, __ATOMIC_RELAXED);
+	    __atomic_fetch_add(&global, n, __ATOMIC_RELAXED);
+	}
+    }
+
+    int64_t approx(void) const{
+	return __atomic_load_n(&global, __ATOMIC_RELAXED);
+    }
+
+    int64_t sum(void) const{
+	auto n = approx();
+	for(size_t i=0; i<kShards; i++)
+	    n += __atomic_load_n(&shards[i].n, __ATOMIC_RELAXED);
+	return n;
+    }
+
+    /* sum() < limit, looking at the shards only when approx() is too close to tell */
+    bool below(int64_t limit) const{
+	auto n = approx();
+	if(n + kError < limit)
+	    return true;
+	if(n - kError >= limit)
+	    return false;
+	return sum() < limit;
+    }
+
+    /* only while no thread adds */
+    void set(int64_t n){
+	for(size_t i=0; i<kShards; i++)
+	    shards[i].n = 0;
+	global = n;
+    }
+
+  private:
+    static size_t slot(void){
+	static size_t next = 0;
+	thread_local size_t id = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED) % kShards;
+	return id;
+    }
+
+    struct alignas(64) shard_t{
+	int64_t n = 0;
+    };
+    shard_t shards[kShards];
+    alignas(64) int64_t global = 0;
+};
+
+#endif  // UTIL_COUNTER_H_
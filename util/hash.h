@@ -2,6 +2,8 @@
 #define UTIL_HASH_H_
 
 #include <functional>
+#include <cstdint>
+#include <cstring>
 #include <stddef.h>
 
 inline size_t standard(const void* _ptr, size_t _len,
@@ -241,16 +243,140 @@ uint64_t xxhash(const void *data, size_t length, size_t seed)
     return hash_compute(data, length, seed, 0);
 }
 
-static size_t
-(*hash_funcs[4])(const void* key, size_t len, size_t seed) = {
-  standard,
-  murmur2,
-	jenkins,
-  xxhash
-};
+// CRC32C, computed with the SSE4.2 crc32 instruction 8 bytes at a time.
+// The 32-bit checksum is spread over 64 bits by an odd multiplier so that
+// both the low bits (modulo) and the high bits (directory index) are usable.
+__attribute__((target("sse4.2")))
+inline size_t crc32c(const void* _ptr, size_t _len, size_t _seed=0xc70f6907UL){
+  const uint8_t* p = static_cast<const uint8_t*>(_ptr);
+  uint64_t crc = static_cast<uint32_t>(_seed);
+  while (_len >= 8) {
+    uint64_t k;
+    memcpy(&k, p, 8);
+    crc = __builtin_ia32_crc32di(crc, k);
+    p += 8;
+    _len -= 8;
+  }
+  while (_len > 0) {
+    crc = __builtin_ia32_crc32qi(static_cast<uint32_t>(crc), *p++);
+    _len--;
+  }
+  return (crc ^ (_seed >> 32)) * NUMBER64_1;
+}
+
+//-----------------------------------------------------------------------------
+// wyhash (final version 4), by Wang Yi -- public domain
+static inline void _wymum(uint64_t* A, uint64_t* B){
+  __uint128_t r = *A;
+  r *= *B;
+  *A = static_cast<uint64_t>(r);
+  *B = static_cast<uint64_t>(r >> 64);
+}
 
-inline size_t h(const void* key, size_t len, size_t seed=0xc70697UL) {
-  return hash_funcs[0](key, len, seed);
+static inline uint64_t _wymix(uint64_t A, uint64_t B){
+  _wymum(&A, &B);
+  return A ^ B;
 }
 
+static inline uint64_t _wyr8(const uint8_t* p){ uint64_t v; memcpy(&v, p, 8); return v; }
+static inline uint64_t _wyr4(const uint8_t* p){ uint32_t v; memcpy(&v, p, 4); return v; }
+static inline uint64_t _wyr3(const uint8_t* p, size_t k){
+  return (((uint64_t)p[0]) << 16) | (((uint64_t)p[k >> 1]) << 8) | p[k - 1];
+}
+
+inline size_t wyhash(const void* key, size_t len, size_t seed=0xc70f6907UL){
+  static const uint64_t secret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull,
+				     0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull};
+  const uint8_t* p = static_cast<const uint8_t*>(key);
+  seed ^= _wymix(seed ^ secret[0], secret[1]);
+  uint64_t a, b;
+  if (len <= 16) {
+    if (len >= 4) {
+      a = (_wyr4(p) << 32) | _wyr4(p + ((len >> 3) << 2));
+      b = (_wyr4(p + len - 4) << 32) | _wyr4(p + len - 4 - ((len >> 3) << 2));
+    } else if (len > 0) {
+      a = _wyr3(p, len);
+      b = 0;
+    } else {
+      a = b = 0;
+    }
+  } else {
+    size_t i = len;
+    if (i > 48) {
+      uint64_t see1 = seed, see2 = seed;
+      do {
+	seed = _wymix(_wyr8(p) ^ secret[1], _wyr8(p + 8) ^ seed);
+	see1 = _wymix(_wyr8(p + 16) ^ secret[2], _wyr8(p + 24) ^ see1);
+	see2 = _wymix(_wyr8(p + 32) ^ secret[3], _wyr8(p + 40) ^ see2);
+	p += 48;
+	i -= 48;
+      } while (i > 48);
+      seed ^= see1 ^ see2;
+    }
+    while (i > 16) {
+      seed = _wymix(_wyr8(p) ^ secret[1], _wyr8(p + 8) ^ seed);
+      i -= 16;
+      p += 16;
+    }
+    a = _wyr8(p + i - 16);
+    b = _wyr8(p + i - 8);
+  }
+  a ^= secret[1];
+  b ^= seed;
+  _wymum(&a, &b);
+  return _wymix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+// Multiply-shift over 8-byte words, a single multiplication for integer keys.
+// The high half is folded into the low half, since engines take both the
+// remainder (linear probing, cuckoo) and the top bits (extendible) of a hash.
+inline size_t multiply_shift(const void* _ptr, size_t _len, size_t _seed=0xc70f6907UL){
+  const uint8_t* p = static_cast<const uint8_t*>(_ptr);
+  uint64_t hash = _seed;
+  while (_len >= 8) {
+    uint64_t k;
+    memcpy(&k, p, 8);
+    hash = (hash ^ k) * NUMBER64_1;
+    hash ^= hash >> 32;
+    p += 8;
+    _len -= 8;
+  }
+  if (_len > 0) {
+    uint64_t k = 0;
+    memcpy(&k, p, _len);
+    hash = (hash ^ k) * NUMBER64_1;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+// Hash policies, passed to the engines as a template parameter so that the
+// hash function is resolved (and inlined) at compile time.
+// Extendible hashing, the Bloom filter and the hot cache use the top bits of
+// the hash, so a function that only produces kBits < 64 bits (murmur2) is
+// spread over 64 bits by an odd multiplier, as crc32c does itself.
+template <size_t (*F)(const void*, size_t, size_t), size_t kBits = 64>
+struct hash_policy{
+  static size_t hash(const void* key, size_t len, size_t seed){
+    if constexpr (kBits < 64)
+      return F(key, len, seed) * NUMBER64_1;
+    else
+      return F(key, len, seed);
+  }
+};
+
+using std_hash = hash_policy<standard>;
+using murmur2_hash = hash_policy<murmur2, 32>;
+using jenkins_hash = hash_policy<jenkins>;
+using xx_hash = hash_policy<xxhash>;
+using crc32c_hash = hash_policy<crc32c>;
+using wy_hash = hash_policy<wyhash>;
+using mulshift_hash = hash_policy<multiply_shift>;
+
+// engines hash with HASH_POLICY unless told otherwise (make HASH=wy_hash ...)
+#ifndef HASH_POLICY
+#define HASH_POLICY std_hash
+#endif
+using default_hash = HASH_POLICY;
+
 #endif  // UTIL_HASH_H_
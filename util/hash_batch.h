@@ -0,0 +1,121 @@
+#ifndef UTIL_HASH_BATCH_H_
+#define UTIL_HASH_BATCH_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <immintrin.h>
+
+#include "util/hash.h"
+#include "util/key_traits.h"
+#include "util/pair.h"
+
+/* Batched hashing: out[i] = KeyTraits<Key_t, Hasher>::hash(kv[i].key, seed).
+ * For std_hash, mulshift_hash and xx_hash on keys made of 8-byte words (integers, char[8*k])
+ * 4 (AVX2) or 8 (AVX-512) keys are hashed per vector, two vectors per iteration.
+ * The instruction set is picked once at startup from CPUID; HASH_SIMD=scalar|avx2|avx512
+ * in the environment caps it, e.g., to compare against the scalar loop. */
+
+enum hash_simd_t{
+    HASH_SIMD_SCALAR = 0,
+    HASH_SIMD_AVX2,
+    HASH_SIMD_AVX512
+};
+
+inline hash_simd_t hash_simd_detect(void){
+    __builtin_cpu_init();
+    hash_simd_t level = HASH_SIMD_SCALAR;
+    if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+	level = HASH_SIMD_AVX512;
+    else if(__builtin_cpu_supports("avx2"))
+	level = HASH_SIMD_AVX2;
+
+    const char* env = getenv("HASH_SIMD");
+    if(env != nullptr){
+	if(strcmp(env, "scalar") == 0)
+	    level = HASH_SIMD_SCALAR;
+	else if(strcmp(env, "avx2") == 0 && level > HASH_SIMD_AVX2)
+	    level = HASH_SIMD_AVX2;
+    }
+    return level;
+}
+
+inline const hash_simd_t hash_simd = hash_simd_detect();
+
+template <typename Hasher>
+constexpr bool hash_has_lanes = std::is_same_v<Hasher, std_hash> || std::is_same_v<Hasher, mulshift_hash> || std::is_same_v<Hasher, xx_hash>;
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+namespace hash_avx2{
+struct ops{
+    using V = __m256i;
+    static const size_t kLanes = 4;
+
+    static V set1(uint64_t x){ return _mm256_set1_epi64x(x); }
+    static V add(V a, V b){ return _mm256_add_epi64(a, b); }
+    static V bxor(V a, V b){ return _mm256_xor_si256(a, b); }
+    template <int n> static V srli(V a){ return _mm256_srli_epi64(a, n); }
+    template <int r> static V rotl(V a){ return _mm256_or_si256(_mm256_slli_epi64(a, r), _mm256_srli_epi64(a, 64-r)); }
+    /* no 64-bit multiply before AVX-512DQ: lo*lo + ((hi*lo + lo*hi) << 32) */
+    static V mul(V a, V b){
+	V lo = _mm256_mul_epu32(a, b);
+	V cross = _mm256_add_epi64(_mm256_mul_epu32(_mm256_srli_epi64(a, 32), b), _mm256_mul_epu32(a, _mm256_srli_epi64(b, 32)));
+	return _mm256_add_epi64(lo, _mm256_slli_epi64(cross, 32));
+    }
+    static V stride(size_t s){ return _mm256_set_epi64x(3*s, 2*s, s, 0); }
+    static V gather(const char* p, V idx){ return _mm256_i64gather_epi64((const long long*)p, idx, 1); }
+    static void store(size_t* out, V v){ _mm256_storeu_si256((__m256i*)out, v); }
+};
+#include "util/hash_batch_kernels.h"
+}
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512dq")
+namespace hash_avx512{
+/* masked forms of the intrinsics keep gcc from warning about their undefined pass-through operand */
+struct ops{
+    using V = __m512i;
+    static const size_t kLanes = 8;
+
+    static V set1(uint64_t x){ return _mm512_set1_epi64(x); }
+    static V add(V a, V b){ return _mm512_add_epi64(a, b); }
+    static V bxor(V a, V b){ return _mm512_xor_si512(a, b); }
+    template <int n> static V srli(V a){ return _mm512_maskz_srli_epi64(0xFF, a, n); }
+    template <int r> static V rotl(V a){ return _mm512_maskz_rol_epi64(0xFF, a, r); }
+    static V mul(V a, V b){ return _mm512_mullo_epi64(a, b); }
+    static V stride(size_t s){ return _mm512_set_epi64(7*s, 6*s, 5*s, 4*s, 3*s, 2*s, s, 0); }
+    static V gather(const char* p, V idx){ return _mm512_mask_i64gather_epi64(_mm512_setzero_si512(), 0xFF, idx, p, 1); }
+    static void store(size_t* out, V v){ _mm512_storeu_si512(out, v); }
+};
+#include "util/hash_batch_kernels.h"
+}
+#pragma GCC pop_options
+
+/* rehash loops (resize, split) hash the old table this many slots at a time */
+const size_t kHashBatch = 256;
+
+/* keys stride bytes apart, e.g., the keys of a Pair array or the key array of a table (see util/layout.h) */
+template <typename Key_t, typename Hasher>
+void hash_batch(const Key_t* key, size_t stride, size_t num, size_t seed, size_t* out){
+    size_t done = 0;
+    auto base = reinterpret_cast<const char*>(key);
+    if constexpr(hash_has_lanes<Hasher> && sizeof(Key_t) % 8 == 0 && (std::is_integral_v<Key_t> || std::is_array_v<Key_t>)){
+	constexpr size_t W = sizeof(Key_t) / 8;
+	if(hash_simd == HASH_SIMD_AVX512)
+	    done = hash_avx512::hash_batch<Hasher, W>(base, stride, num, seed, out);
+	else if(hash_simd == HASH_SIMD_AVX2)
+	    done = hash_avx2::hash_batch<Hasher, W>(base, stride, num, seed, out);
+    }
+    for(size_t i=done; i<num; i++)
+	out[i] = KeyTraits<Key_t, Hasher>::hash(*reinterpret_cast<const Key_t*>(base + i*stride), seed);
+}
+
+template <typename Key_t, typename Hasher, typename Value_t>
+void hash_batch(const Pair<Key_t, Value_t>* kv, size_t num, size_t seed, size_t* out){
+    hash_batch<Key_t, Hasher>(&kv[0].key, sizeof(Pair<Key_t, Value_t>), num, seed, out);
+}
+
+#endif  // UTIL_HASH_BATCH_H_
@@ -0,0 +1,122 @@
+/* Lane-parallel versions of the hash policies of util/hash.h.
+ * No include guard: util/hash_batch.h includes this file once per instruction set,
+ * inside a namespace that provides `ops` (vector type V, kLanes and the 64-bit lane operations)
+ * and under the matching `#pragma GCC target`.
+ * Every key is read as W little-endian 8-byte words, so these match the scalar functions
+ * bit for bit only for keys whose size is a multiple of 8. */
+
+using V = ops::V;
+
+inline V shift_mix(V v){
+    return ops::bxor(v, ops::template srli<47>(v));
+}
+
+/* std::_Hash_bytes (libstdc++, 64-bit) */
+template <size_t W>
+inline V std_lanes(const V* w, size_t seed){
+    const uint64_t kMul = (((uint64_t)0xc6a4a793UL) << 32) + (uint64_t)0x5bd1e995UL;
+    const V mul = ops::set1(kMul);
+    V hash = ops::set1(seed ^ (8*W*kMul));
+    for(size_t j=0; j<W; j++){
+	V data = ops::mul(shift_mix(ops::mul(w[j], mul)), mul);
+	hash = ops::mul(ops::bxor(hash, data), mul);
+    }
+    hash = ops::mul(shift_mix(hash), mul);
+    return shift_mix(hash);
+}
+
+/* multiply_shift */
+template <size_t W>
+inline V mulshift_lanes(const V* w, size_t seed){
+    const V mul = ops::set1(NUMBER64_1);
+    V hash = ops::set1(seed);
+    for(size_t j=0; j<W; j++){
+	hash = ops::mul(ops::bxor(hash, w[j]), mul);
+	hash = ops::bxor(hash, ops::template srli<32>(hash));
+    }
+    return hash;
+}
+
+inline V xx_round(V acc, V w){
+    acc = ops::add(acc, ops::mul(w, ops::set1(NUMBER64_2)));
+    acc = ops::template rotl<31>(acc);
+    return ops::mul(acc, ops::set1(NUMBER64_1));
+}
+
+inline V xx_merge(V hash, V v){
+    hash = ops::bxor(hash, xx_round(ops::set1(0), v));
+    return ops::add(ops::mul(hash, ops::set1(NUMBER64_1)), ops::set1(NUMBER64_4));
+}
+
+/* xxhash (64-bit) */
+template <size_t W>
+inline V xx_lanes(const V* w, size_t seed){
+    V hash;
+    size_t j = 0;
+    if constexpr(W >= 4){
+	V v1 = ops::set1(seed + NUMBER64_1 + NUMBER64_2);
+	V v2 = ops::set1(seed + NUMBER64_2);
+	V v3 = ops::set1(seed);
+	V v4 = ops::set1(seed - NUMBER64_1);
+	for(; j+4<=W; j+=4){
+	    v1 = xx_round(v1, w[j]);
+	    v2 = xx_round(v2, w[j+1]);
+	    v3 = xx_round(v3, w[j+2]);
+	    v4 = xx_round(v4, w[j+3]);
+	}
+	hash = ops::add(ops::add(ops::template rotl<1>(v1), ops::template rotl<7>(v2)),
+		ops::add(ops::template rotl<12>(v3), ops::template rotl<18>(v4)));
+	hash = xx_merge(hash, v1);
+	hash = xx_merge(hash, v2);
+	hash = xx_merge(hash, v3);
+	hash = xx_merge(hash, v4);
+    }
+    else
+	hash = ops::set1(seed + NUMBER64_5);
+
+    hash = ops::add(hash, ops::set1(8*W));
+    for(; j<W; j++){
+	hash = ops::bxor(hash, xx_round(ops::set1(0), w[j]));
+	hash = ops::add(ops::mul(ops::template rotl<27>(hash), ops::set1(NUMBER64_1)), ops::set1(NUMBER64_4));
+    }
+
+    hash = ops::bxor(hash, ops::template srli<33>(hash));
+    hash = ops::mul(hash, ops::set1(NUMBER64_2));
+    hash = ops::bxor(hash, ops::template srli<29>(hash));
+    hash = ops::mul(hash, ops::set1(NUMBER64_3));
+    return ops::bxor(hash, ops::template srli<32>(hash));
+}
+
+template <typename Hasher, size_t W>
+inline V lanes(const V* w, size_t seed){
+    if constexpr(std::is_same_v<Hasher, std_hash>)
+	return std_lanes<W>(w, seed);
+    else if constexpr(std::is_same_v<Hasher, mulshift_hash>)
+	return mulshift_lanes<W>(w, seed);
+    else
+	return xx_lanes<W>(w, seed);
+}
+
+/* Hashes keys at base, base+stride, ... two vectors at a time so that the multiplication
+ * chains of both overlap; returns how many keys were hashed, the rest is left to the caller. */
+template <typename Hasher, size_t W>
+size_t hash_batch(const char* base, size_t stride, size_t num, size_t seed, size_t* out){
+    const V idx = ops::stride(stride);
+    size_t i = 0;
+    for(; i+2*ops::kLanes<=num; i+=2*ops::kLanes){
+	V a[W], b[W];
+	for(size_t j=0; j<W; j++){
+	    a[j] = ops::gather(base + i*stride + 8*j, idx);
+	    b[j] = ops::gather(base + (i+ops::kLanes)*stride + 8*j, idx);
+	}
+	ops::store(out+i, lanes<Hasher, W>(a, seed));
+	ops::store(out+i+ops::kLanes, lanes<Hasher, W>(b, seed));
+    }
+    for(; i+ops::kLanes<=num; i+=ops::kLanes){
+	V a[W];
+	for(size_t j=0; j<W; j++)
+	    a[j] = ops::gather(base + i*stride + 8*j, idx);
+	ops::store(out+i, lanes<Hasher, W>(a, seed));
+    }
+    return i;
+}
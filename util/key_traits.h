@@ -0,0 +1,104 @@
+#ifndef UTIL_KEY_TRAITS_H_
+#define UTIL_KEY_TRAITS_H_
+
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <immintrin.h>
+
+#include "util/hash.h"
+
+/* Key handling policy of the engines: hashing, equality, order, emptiness and copies.
+ * An empty slot holds an all-zero key (see INVALID<Key_t> in util/pair.h), a deleted one in an
+ * open addressing table an all-ones key, so neither value can be used as a key.
+ * Integer keys compile down to single-register operations, fixed-width string keys
+ * (char[N]) are compared 16/32 bytes at a time. Keys are hashed with the Hasher policy
+ * of the engine (see util/hash.h). */
+const size_t kDefaultSeed = 0xc70697UL;
+
+template <typename Key_t, typename Hasher = default_hash, typename = void>
+struct KeyTraits;
+
+template <typename Key_t, typename Hasher>
+struct KeyTraits<Key_t, Hasher, std::enable_if_t<std::is_integral_v<Key_t>>>{
+    static const void* data(const Key_t& key){ return &key; }
+
+    static size_t hash(const Key_t& key, size_t seed = kDefaultSeed){
+	return Hasher::hash(&key, sizeof(Key_t), seed);
+    }
+
+    static bool equal(const Key_t& a, const Key_t& b){ return a == b; }
+    static int compare(const Key_t& a, const Key_t& b){ return (a > b) - (a < b); }
+    static bool empty(const Key_t& key){ return key == 0; }
+    static bool deleted(const Key_t& key){ return key == (Key_t)~(Key_t)0; }
+    static void copy(Key_t& dst, const Key_t& src){ dst = src; }
+    static void clear(Key_t& key){ key = 0; }
+    static void mark_deleted(Key_t& key){ key = (Key_t)~(Key_t)0; }
+};
+
+template <size_t N, typename Hasher>
+struct KeyTraits<char[N], Hasher>{
+    using Key_t = char[N];
+
+    static const void* data(const Key_t& key){ return key; }
+
+    static size_t hash(const Key_t& key, size_t seed = kDefaultSeed){
+	return Hasher::hash(key, N, seed);
+    }
+
+    static bool equal(const Key_t& a, const Key_t& b){
+	if constexpr(N == 16){
+	    __m128i x = _mm_loadu_si128((const __m128i*)a);
+	    __m128i y = _mm_loadu_si128((const __m128i*)b);
+	    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) == 0xFFFF;
+	}
+	else if constexpr(N == 32){
+#ifdef __AVX2__
+	    __m256i x = _mm256_loadu_si256((const __m256i*)a);
+	    __m256i y = _mm256_loadu_si256((const __m256i*)b);
+	    return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) == 0xFFFFFFFFu;
+#else
+	    __m128i lo = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)a), _mm_loadu_si128((const __m128i*)b));
+	    __m128i hi = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(a+16)), _mm_loadu_si128((const __m128i*)(b+16)));
+	    return _mm_movemask_epi8(_mm_and_si128(lo, hi)) == 0xFFFF;
+#endif
+	}
+	else
+	    return memcmp(a, b, N) == 0;
+    }
+
+    /* byte order, which is strcmp order for the zero-padded keys of the benchmarks */
+    static int compare(const Key_t& a, const Key_t& b){ return memcmp(a, b, N); }
+
+    static bool empty(const Key_t& key){
+	if constexpr(N == 16){
+	    __m128i x = _mm_loadu_si128((const __m128i*)key);
+	    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) == 0xFFFF;
+	}
+	else if constexpr(N == 32){
+#ifdef __AVX2__
+	    __m256i x = _mm256_loadu_si256((const __m256i*)key);
+	    return _mm256_testz_si256(x, x);
+#else
+	    __m128i x = _mm_or_si128(_mm_loadu_si128((const __m128i*)key), _mm_loadu_si128((const __m128i*)(key+16)));
+	    return _mm_movemask_epi8(_mm_cmpeq_epi8(x, _mm_setzero_si128())) == 0xFFFF;
+#endif
+	}
+	else{
+	    static const char zero[N] = {0, };
+	    return memcmp(key, zero, N) == 0;
+	}
+    }
+
+    static bool deleted(const Key_t& key){
+	struct ones_t{ Key_t key; ones_t(void){ memset(key, 0xFF, N); } };
+	static const ones_t ones;
+	return equal(key, ones.key);
+    }
+
+    static void copy(Key_t& dst, const Key_t& src){ memcpy(dst, src, N); }
+    static void clear(Key_t& key){ memset(key, 0, N); }
+    static void mark_deleted(Key_t& key){ memset(key, 0xFF, N); }
+};
+
+#endif  // UTIL_KEY_TRAITS_H_
@@ -0,0 +1,97 @@
+#ifndef UTIL_LAYOUT_H_
+#define UTIL_LAYOUT_H_
+
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <cstdio>
+
+#include "util/pair.h"
+
+/* Slot storage policy of the open addressing engines (linear probing, cuckoo hashing).
+ * aos_layout interleaves keys and values in one Pair<Key_t, Value_t> array. soa_layout keeps them in two
+ * separate cache-line aligned arrays: probes only pull keys through the cache, e.g., 8 uint64_t keys
+ * per line instead of 4 pairs, and the value line of a slot is touched only on a hit.
+ * Both hand out the same table: key(i) and value(i) of slot i, get(i)/set(i, kv) to move whole pairs
+ * (get loads the value as ValueTraits does, for value operations may change it under a shared lock),
+ * keys(i) and kStride to hash a run of slots with hash_batch (util/hash_batch.h), and kProbeBytes,
+ * the bytes a probe of slot i reads from keys(i) on. */
+
+struct aos_layout{
+    template <typename Key_t, typename Value_t>
+    class table{
+      public:
+	static const size_t kStride = sizeof(Pair<Key_t, Value_t>);
+	static const size_t kProbeBytes = sizeof(Pair<Key_t, Value_t>);
+
+	table(size_t num): _(new Pair<Key_t, Value_t>[num]){ }
+	~table(void){ delete[] _; }
+
+	Key_t& key(size_t i){ return _[i].key; }
+	Value_t& value(size_t i){ return _[i].value; }
+	const Key_t* keys(size_t i) const{ return &_[i].key; }
+	Pair<Key_t, Value_t> get(size_t i) const{
+	    Pair<Key_t, Value_t> kv;
+	    memcpy((void*)&kv.key, &_[i].key, sizeof(Key_t));
+	    kv.value = ValueTraits<Value_t>::load(_[i].value);
+	    return kv;
+	}
+	void set(size_t i, const Pair<Key_t, Value_t>& kv){ memcpy(&_[i], &kv, sizeof(Pair<Key_t, Value_t>)); }
+
+      private:
+	Pair<Key_t, Value_t>* _;
+    };
+};
+
+struct soa_layout{
+    template <typename Key_t, typename Value_t>
+    class table{
+      public:
+	static const size_t kStride = sizeof(Key_t);
+	static const size_t kProbeBytes = sizeof(Key_t);
+
+	/* empty slots hold all-zero keys, values are only read behind a key */
+	table(size_t num): _key((Key_t*)alloc(num*sizeof(Key_t))), _value((Value_t*)alloc(num*sizeof(Value_t))){
+	    memset((void*)_key, 0, num*sizeof(Key_t));
+	}
+	~table(void){
+	    free(_key);
+	    free(_value);
+	}
+
+	Key_t& key(size_t i){ return _key[i]; }
+	Value_t& value(size_t i){ return _value[i]; }
+	const Key_t* keys(size_t i) const{ return &_key[i]; }
+	Pair<Key_t, Value_t> get(size_t i) const{
+	    Pair<Key_t, Value_t> kv;
+	    memcpy((void*)&kv.key, &_key[i], sizeof(Key_t));
+	    kv.value = ValueTraits<Value_t>::load(_value[i]);
+	    return kv;
+	}
+	void set(size_t i, const Pair<Key_t, Value_t>& kv){
+	    memcpy((void*)&_key[i], &kv.key, sizeof(Key_t));
+	    _value[i] = kv.value;
+	}
+
+      private:
+	static void* alloc(size_t bytes){
+	    void* p = aligned_alloc(64, (bytes + 63) / 64 * 64);
+	    if(p == nullptr){
+		fprintf(stderr, "error: memory allocation failed.\n");
+		exit(1);
+	    }
+	    return p;
+	}
+
+	Key_t* _key;
+	Value_t* _value;
+    };
+};
+
+// open addressing engines store their slots with LAYOUT_POLICY unless told otherwise (make LAYOUT=soa_layout ...)
+#ifndef LAYOUT_POLICY
+#define LAYOUT_POLICY aos_layout
+#endif
+using default_layout = LAYOUT_POLICY;
+
+#endif  // UTIL_LAYOUT_H_
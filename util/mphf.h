@@ -0,0 +1,152 @@
+#ifndef UTIL_MPHF_H_
+#define UTIL_MPHF_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+#include <algorithm>
+
+#include "util/pair.h"
+#include "util/key_traits.h"
+
+/* Minimal perfect hash function over a fixed key set (PTHash, Pibiri and Trani, SIGIR '21): maps the
+ * num keys it was built for onto [0, num) without collisions, any other key onto some position in it.
+ * A key hashes to one of num/kBucketSize buckets; every bucket has a 16-bit pilot, found at build time,
+ * such that position(hash ^ pilot) is a free slot for each of its keys. Positions are drawn from a
+ * range of num/kAlpha slots, so the last buckets still find free slots in a few tries, and the keys
+ * that land beyond num are remapped onto the slots below num left free. A lookup reads its pilot and,
+ * for about 1 - kAlpha of the keys, a remap entry: about 0.7 bytes per key at kBucketSize 3. */
+template <typename Key_t, typename Hasher = default_hash>
+class mphf{
+    using KT = KeyTraits<Key_t, Hasher>;
+  public:
+    static const size_t kBucketSize = 3;  // average keys per bucket
+    static constexpr double kAlpha = 0.99;
+    static const size_t kMaxPilot = 65536;
+    static const int kMaxSeeds = 16;
+
+    /* keys must be distinct; builds on one thread */
+    template <typename Value_t>
+    void build(const Pair<Key_t, Value_t>* kv, size_t _num){
+	num = _num;
+	range = std::max((size_t)(num / kAlpha), num + 1);
+	nbuckets = std::max(num / kBucketSize, (size_t)1);
+	for(seed=kDefaultSeed; seed<kDefaultSeed+kMaxSeeds; seed++){
+	    if(search(kv))
+		return;
+	}
+	fprintf(stderr, "%s: no pilots found for %zu keys after %d seeds (duplicate keys?)\n", __func__, num, kMaxSeeds);
+	exit(1);
+    }
+
+    size_t operator()(const Key_t& key) const{
+	auto h = hash(key);
+	auto pos = position(h, pilots[bucket(h)]);
+	return pos < num ? pos : remap[pos - num];
+    }
+
+    const uint16_t* pilot_of(const Key_t& key) const{ return &pilots[bucket(hash(key))]; }
+    size_t Bytes(void) const{ return pilots.size() * sizeof(uint16_t) + remap.size() * sizeof(uint32_t); }
+
+  private:
+    /* the engines' hashers need not fill all 64 bits, so the key hash is finalized once more */
+    size_t hash(const Key_t& key) const{
+	uint64_t h = KT::hash(key, seed);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdUL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53UL;
+	h ^= h >> 33;
+	return h;
+    }
+    size_t bucket(size_t h) const{
+	return ((h & 0xffffffffUL) * nbuckets) >> 32;
+    }
+    size_t position(size_t h, uint16_t pilot) const{
+	uint64_t x = (h ^ (pilot * 0x9e3779b97f4a7c15UL)) * 0xbf58476d1ce4e5b9UL;
+	x ^= x >> 31;
+	return ((unsigned __int128)x * range) >> 64;
+    }
+
+    /* buckets in decreasing size, each with the first pilot under which its keys take free slots */
+    template <typename Value_t>
+    bool search(const Pair<Key_t, Value_t>* kv){
+	std::vector<size_t> hashes(num);
+	std::vector<uint32_t> start(nbuckets + 1, 0);
+	for(size_t i=0; i<num; i++){
+	    hashes[i] = hash(kv[i].key);
+	    start[bucket(hashes[i]) + 1]++;
+	}
+	size_t max_size = 0;
+	for(size_t b=0; b<nbuckets; b++){
+	    max_size = std::max(max_size, (size_t)start[b+1]);
+	    start[b+1] += start[b];
+	}
+	std::vector<size_t> members(num);
+	{
+	    std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+	    for(size_t i=0; i<num; i++)
+		members[fill[bucket(hashes[i])]++] = hashes[i];
+	}
+	std::vector<uint32_t> order(nbuckets);
+	for(size_t b=0; b<nbuckets; b++)
+	    order[b] = b;
+	std::stable_sort(order.begin(), order.end(), [&start](uint32_t a, uint32_t b){
+		return start[a+1] - start[a] > start[b+1] - start[b];
+	    });
+
+	pilots.assign(nbuckets, 0);
+	std::vector<uint64_t> taken((range + 63) / 64, 0);
+	auto is_taken = [&taken](size_t pos){ return (taken[pos / 64] >> (pos % 64)) & 1; };
+	std::vector<size_t> pos(max_size);
+	for(auto b: order){
+	    auto first = &members[start[b]];
+	    size_t size = start[b+1] - start[b];
+	    if(size == 0)
+		break;
+	    /* equal hashes collide under every pilot: a duplicate key, or a 64-bit collision the next seed fixes */
+	    std::sort(first, first + size);
+	    if(std::adjacent_find(first, first + size) != first + size)
+		return false;
+	    size_t pilot = 0;
+	    for(; pilot<kMaxPilot; pilot++){
+		size_t i = 0;
+		for(; i<size; i++){
+		    pos[i] = position(first[i], pilot);
+		    if(is_taken(pos[i]) || std::find(pos.begin(), pos.begin() + i, pos[i]) != pos.begin() + i)
+			break;
+		}
+		if(i == size)
+		    break;
+	    }
+	    if(pilot == kMaxPilot)
+		return false;
+	    pilots[b] = pilot;
+	    for(size_t i=0; i<size; i++)
+		taken[pos[i] / 64] |= (uint64_t)1 << (pos[i] % 64);
+	}
+
+	/* the i-th taken slot beyond num goes to the i-th free slot below it */
+	remap.assign(range - num, 0);
+	size_t free_slot = 0;
+	for(size_t p=num; p<range; p++){
+	    if(!is_taken(p))
+		continue;
+	    while(is_taken(free_slot))
+		free_slot++;
+	    remap[p - num] = free_slot++;
+	}
+	return true;
+    }
+
+    size_t num;
+    size_t range;
+    size_t nbuckets;
+    size_t seed;
+    std::vector<uint16_t> pilots;
+    std::vector<uint32_t> remap;
+};
+
+#endif  // UTIL_MPHF_H_
@@ -4,9 +4,9 @@
 #include <cstdlib>
 #include <cstring>
 
-typedef int64_t Value_t;
+#include "util/value_traits.h"
 
-template <typename Key_t>
+template <typename Key_t, typename Value_t = default_value>
 struct Pair{
     Key_t key;
     Value_t value;
@@ -31,8 +31,6 @@ struct Pair{
 template <typename Key_t>
 Key_t INVALID;
 
-const Value_t NONE = 0;
-
 template <typename Key_t>
 void invalid_initialize(void){
     if constexpr(sizeof(Key_t) > 8)
@@ -41,8 +39,8 @@ void invalid_initialize(void){
 	memset(&INVALID<Key_t>, 0, sizeof(Key_t));
 }
 
-template <typename Key_t>
-void gen_input(Pair<Key_t>* arr, int num){
+template <typename Key_t, typename Value_t>
+void gen_input(Pair<Key_t, Value_t>* arr, int num){
     if constexpr(sizeof(Key_t) > 8){
 	char s[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
 	for(int i=0; i<num; i++){
@@ -60,6 +58,19 @@ void gen_input(Pair<Key_t>* arr, int num){
 	}
     }
 }
-		
+
+/* num keys that gen_input never generates, for lookups that miss: integers above any gen_input key
+ * (offset >= its num), strings starting with a character outside its alphabet */
+template <typename Key_t, typename Value_t>
+void gen_misses(Pair<Key_t, Value_t>* arr, int num, int offset){
+    gen_input(arr, num);
+    for(int i=0; i<num; i++){
+	if constexpr(sizeof(Key_t) > 8)
+	    arr[i].key[0] = '#';
+	else
+	    arr[i].key = offset + i + 1;
+    }
+}
+
 #endif
 
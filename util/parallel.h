@@ -0,0 +1,109 @@
+#ifndef UTIL_PARALLEL_H_
+#define UTIL_PARALLEL_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "util/wait.h"
+
+/* Runs fn(tid) for every tid in [0, num_threads), tid 0 on the calling thread, and returns once all are done. */
+template <typename F>
+void parallel_run(size_t num_threads, F&& fn){
+    std::vector<std::thread> workers;
+    for(size_t t=1; t<num_threads; t++)
+	workers.emplace_back([&fn, t]{ fn(t); });
+    fn(0);
+    for(auto& w: workers)
+	w.join();
+}
+
+/* Radix partition of [0, num) on num_threads threads: part(from, n, id) writes the partition
+ * (< num_parts) of items from..from+n-1 to id[0..n-1]. On return order holds the items grouped
+ * by partition, in their original order within a partition, and bounds[p]..bounds[p+1]
+ * is the range of partition p in order. */
+template <typename F>
+void parallel_partition(size_t num, size_t num_parts, size_t num_threads, F&& part,
+	std::vector<uint32_t>& order, std::vector<size_t>& bounds){
+    std::vector<uint32_t> id(num);
+    std::vector<std::vector<size_t>> offset(num_threads, std::vector<size_t>(num_parts, 0));
+    parallel_run(num_threads, [&](size_t tid){
+	    size_t from = num*tid/num_threads, to = num*(tid+1)/num_threads;
+	    part(from, to - from, &id[from]);
+	    for(size_t i=from; i<to; i++)
+		offset[tid][id[i]]++;
+	});
+
+    bounds.resize(num_parts+1);
+    size_t sum = 0;
+    for(size_t p=0; p<num_parts; p++){
+	bounds[p] = sum;
+	for(size_t t=0; t<num_threads; t++){
+	    auto cnt = offset[t][p];
+	    offset[t][p] = sum;
+	    sum += cnt;
+	}
+    }
+    bounds[num_parts] = sum;
+
+    order.resize(num);
+    parallel_run(num_threads, [&](size_t tid){
+	    size_t from = num*tid/num_threads, to = num*(tid+1)/num_threads;
+	    for(size_t i=from; i<to; i++)
+		order[offset[tid][id[i]]++] = i;
+	});
+}
+
+/* A job split into chunks that any thread can help with. run() hands the chunks out to the calling
+ * thread, num_threads-1 extra workers and every thread that calls help() meanwhile, e.g., while it
+ * waits for the job to finish, and returns once all chunks are done. */
+class chunk_pool{
+  public:
+    void run(size_t num_chunks, size_t num_threads, const std::function<void(size_t)>& fn){
+	work = &fn;
+	total = num_chunks;
+	next = 0;
+	done = 0;
+	__atomic_store_n(&active, 1, __ATOMIC_SEQ_CST);
+	parallel_run(num_threads, [this](size_t){ take(); });
+	backoff b;
+	while(__atomic_load_n(&done, __ATOMIC_ACQUIRE) < total)
+	    b.pause();
+	/* helpers may still be looking at this job */
+	__atomic_store_n(&active, 0, __ATOMIC_SEQ_CST);
+	b.reset();
+	while(__atomic_load_n(&helpers, __ATOMIC_SEQ_CST))
+	    b.pause();
+    }
+
+    void help(void){
+	if(!__atomic_load_n(&active, __ATOMIC_ACQUIRE)){
+	    asm("nop");
+	    return;
+	}
+	__atomic_fetch_add(&helpers, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&active, __ATOMIC_SEQ_CST))
+	    take();
+	__atomic_fetch_sub(&helpers, 1, __ATOMIC_SEQ_CST);
+    }
+
+  private:
+    void take(void){
+	size_t chunk;
+	while((chunk = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED)) < total){
+	    (*work)(chunk);
+	    __atomic_fetch_add(&done, 1, __ATOMIC_RELEASE);
+	}
+    }
+
+    const std::function<void(size_t)>* work = nullptr;
+    size_t total = 0;
+    size_t next = 0;
+    size_t done = 0;
+    int active = 0;
+    int helpers = 0;
+};
+
+#endif  // UTIL_PARALLEL_H_
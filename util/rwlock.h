@@ -0,0 +1,238 @@
+#ifndef UTIL_RWLOCK_H_
+#define UTIL_RWLOCK_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <thread>
+#include <shared_mutex>
+#include <immintrin.h>
+
+/* Lock policy of the engines: the stripe locks of linear probing and cuckoo hashing and the segment
+ * locks of extendible hashing. Any type with lock/try_lock/unlock and their _shared forms works,
+ * std::shared_mutex (56 bytes with glibc) being the default.
+ * rw_spinlock is a single 32-bit word: a writer bit, a pending-writer bit that holds off new readers
+ * so that writers do not starve, and the reader count. Waiters spin with pause for kSpin rounds and
+ * yield the core after that. bravo_lock puts a reader bias in front of either of them for read-mostly
+ * workloads. Lock arrays pad every lock to its own cache line (padded_lock), so neighbouring stripes
+ * never share a line whichever lock is used. */
+class rw_spinlock{
+  public:
+    static const uint32_t kWriter = 1;
+    static const uint32_t kPending = 2;
+    static const uint32_t kReader = 4;
+    static const size_t kSpin = 128;
+
+    void lock(void){
+	for(size_t i=0;; i++){
+	    auto s = __atomic_load_n(&state, __ATOMIC_RELAXED);
+	    if((s & ~kPending) == 0){
+		if(__atomic_compare_exchange_n(&state, &s, kWriter, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+		    return;
+	    }
+	    else if(!(s & kPending))
+		__atomic_fetch_or(&state, kPending, __ATOMIC_RELAXED);
+	    relax(i);
+	}
+    }
+
+    bool try_lock(void){
+	auto s = __atomic_load_n(&state, __ATOMIC_RELAXED);
+	return (s & ~kPending) == 0 && __atomic_compare_exchange_n(&state, &s, kWriter, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+
+    void unlock(void){
+	__atomic_fetch_and(&state, ~kWriter, __ATOMIC_RELEASE);
+    }
+
+    void lock_shared(void){
+	for(size_t i=0; !try_lock_shared(); i++)
+	    relax(i);
+    }
+
+    bool try_lock_shared(void){
+	auto s = __atomic_load_n(&state, __ATOMIC_RELAXED);
+	return !(s & (kWriter | kPending)) && __atomic_compare_exchange_n(&state, &s, s + kReader, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+    }
+
+    void unlock_shared(void){
+	__atomic_fetch_sub(&state, kReader, __ATOMIC_RELEASE);
+    }
+
+  private:
+    static void relax(size_t i){
+	if(i < kSpin)
+	    _mm_pause();
+	else
+	    std::this_thread::yield();
+    }
+
+    uint32_t state = 0;
+};
+
+/* BRAVO (Dice and Kogan, USENIX ATC '19) in front of any lock of the policy: while the lock is read-biased a
+ * reader publishes itself in a slot of the global visible readers table, picked by hashing the lock and the
+ * thread, instead of writing the lock word, so the readers of one hot lock touch only their own slots.
+ * A writer takes the underlying lock, revokes the bias and waits until no slot names the lock any more;
+ * the bias is restored by a later slow-path reader, but not before kInhibit times the revocation cost has
+ * passed, which keeps write-heavy locks from paying for revocations over and over. A thread holds at most
+ * kHeld fast-path read locks at a time (further ones take the slow path). */
+class bravo_readers{
+  public:
+    static const size_t kSlots = 4096;
+    static const size_t kHeld = 8;
+
+    static void* volatile* slot(const void* lock){
+	auto h = ((uintptr_t)lock >> 4) * 0x9E3779B97F4A7C15ULL ^ thread_id() * 0xff51afd7ed558ccdULL;
+	return &table[(h * 0xc4ceb9fe1a85ec53ULL) >> (64 - 12)];
+    }
+
+    /* slots this thread holds a fast-path read lock in */
+    struct held_t{
+	const void* lock[kHeld];
+	void* volatile* slot[kHeld];
+	size_t n = 0;
+    };
+    static held_t& held(void){
+	thread_local held_t h;
+	return h;
+    }
+
+    static void* volatile table[kSlots];
+
+  private:
+    static uint64_t thread_id(void){
+	static uint64_t next = 0;
+	thread_local uint64_t id = __atomic_fetch_add(&next, 1, __ATOMIC_RELAXED);
+	return id;
+    }
+};
+inline void* volatile bravo_readers::table[bravo_readers::kSlots] = {};
+
+template <typename Lock = rw_spinlock>
+class bravo_lock{
+  public:
+    static const uint64_t kInhibit = 9;
+
+    void lock_shared(void){
+	if(!fast_shared())
+	    slow_shared();
+    }
+
+    bool try_lock_shared(void){
+	if(fast_shared())
+	    return true;
+	if(!lock_.try_lock_shared())
+	    return false;
+	rebias();
+	return true;
+    }
+
+    void unlock_shared(void){
+	auto& h = bravo_readers::held();
+	for(size_t i=h.n; i-- > 0;){
+	    if(h.lock[i] == this){
+		__atomic_store_n(h.slot[i], nullptr, __ATOMIC_RELEASE);
+		h.n--;
+		h.lock[i] = h.lock[h.n];
+		h.slot[i] = h.slot[h.n];
+		return;
+	    }
+	}
+	lock_.unlock_shared();
+    }
+
+    void lock(void){
+	lock_.lock();
+	revoke();
+    }
+
+    bool try_lock(void){
+	if(!lock_.try_lock())
+	    return false;
+	revoke();
+	return true;
+    }
+
+    void unlock(void){
+	lock_.unlock();
+    }
+
+  private:
+    bool fast_shared(void){
+	auto& h = bravo_readers::held();
+	if(!__atomic_load_n(&rbias, __ATOMIC_ACQUIRE) || h.n == bravo_readers::kHeld)
+	    return false;
+	auto slot = bravo_readers::slot(this);
+	void* expected = nullptr;
+	if(!__atomic_compare_exchange_n(slot, &expected, (void*)this, false, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+	    return false;
+	/* a writer that revoked the bias before our slot was visible will not wait for it */
+	if(!__atomic_load_n(&rbias, __ATOMIC_SEQ_CST)){
+	    __atomic_store_n(slot, nullptr, __ATOMIC_RELEASE);
+	    return false;
+	}
+	h.lock[h.n] = this;
+	h.slot[h.n] = slot;
+	h.n++;
+	return true;
+    }
+
+    void slow_shared(void){
+	lock_.lock_shared();
+	rebias();
+    }
+
+    /* under the read lock, so no writer is revoking meanwhile */
+    void rebias(void){
+	if(!__atomic_load_n(&rbias, __ATOMIC_RELAXED) && __rdtsc() >= __atomic_load_n(&inhibit_until, __ATOMIC_RELAXED))
+	    __atomic_store_n(&rbias, true, __ATOMIC_RELEASE);
+    }
+
+    void revoke(void){
+	if(!__atomic_load_n(&rbias, __ATOMIC_RELAXED))
+	    return;
+	__atomic_store_n(&rbias, false, __ATOMIC_SEQ_CST);
+	auto start = __rdtsc();
+	for(size_t i=0; i<bravo_readers::kSlots; i++){
+	    while(__atomic_load_n(&bravo_readers::table[i], __ATOMIC_ACQUIRE) == this)
+		_mm_pause();
+	}
+	auto now = __rdtsc();
+	__atomic_store_n(&inhibit_until, now + (now - start) * kInhibit, __ATOMIC_RELAXED);
+    }
+
+    Lock lock_;
+    bool rbias = true;
+    uint64_t inhibit_until = 0;
+};
+
+template <typename Lock>
+struct alignas(64) padded_lock : Lock{ };
+
+/* Stripe lock plus the version optimistic readers validate against: an exclusive holder makes
+ * the version odd until it unlocks, so a version that is even and unchanged around a read means
+ * nothing under the lock has changed meanwhile (cuckoo hashing, the cuckoo filter). */
+template <typename Lock>
+struct alignas(64) versioned_lock{
+    Lock mutex;
+    uint64_t version = 0;
+
+    void lock(void){
+	mutex.lock();
+	__atomic_fetch_add(&version, 1, __ATOMIC_ACQ_REL);
+    }
+    void unlock(void){
+	__atomic_fetch_add(&version, 1, __ATOMIC_RELEASE);
+	mutex.unlock();
+    }
+    void lock_shared(void){ mutex.lock_shared(); }
+    void unlock_shared(void){ mutex.unlock_shared(); }
+};
+
+// engines lock with LOCK_POLICY unless told otherwise (make LOCK=rw_spinlock ...)
+#ifndef LOCK_POLICY
+#define LOCK_POLICY std::shared_mutex
+#endif
+using default_lock = LOCK_POLICY;
+
+#endif  // UTIL_RWLOCK_H_
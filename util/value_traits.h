@@ -0,0 +1,83 @@
+#ifndef UTIL_VALUE_TRAITS_H_
+#define UTIL_VALUE_TRAITS_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <mutex>
+#include <shared_mutex>
+#include <type_traits>
+
+/* Value type of the engines, the second template parameter of Pair and of every index. Values live in
+ * the slots themselves: a word (int64_t), or an inline_value<N> for records of N bytes, which Get(key,
+ * value) copies out instead of handing back a pointer to a separately allocated buffer that costs one
+ * more cache miss on every hit. */
+template <size_t N>
+struct inline_value{
+    static_assert(N % sizeof(int64_t) == 0, "inline values are made of whole words");
+    static const size_t kWords = N / sizeof(int64_t);
+    int64_t word[kWords];
+
+    inline_value(void) = default;
+    /* every word holds v, so that a torn copy never compares equal to a value that was stored */
+    inline_value(int64_t v){
+	for(auto& w: word)
+	    w = v;
+    }
+    explicit operator int64_t(void) const{ return word[0]; }
+    bool operator==(const inline_value&) const = default;
+};
+
+/* Value operations of the engines (FetchAdd, CompareExchange, Modify) and the loads of lock-free readers.
+ * A word is changed in place with atomic instructions under a shared lock, so value operations never wait
+ * for each other. An inline_value cannot be: its operations take the exclusive lock (see value_lock), and
+ * lock-free readers copy it out and validate the copy against the stripe version, as they do the key. */
+template <typename Value_t, typename = void>
+struct ValueTraits;
+
+template <typename Value_t>
+struct ValueTraits<Value_t, std::enable_if_t<std::is_integral_v<Value_t>>>{
+    static const bool kAtomic = true;
+
+    static Value_t load(const Value_t& v){ return __atomic_load_n(&v, __ATOMIC_RELAXED); }
+    static void store(Value_t& v, Value_t desired){ __atomic_store_n(&v, desired, __ATOMIC_RELEASE); }
+    static Value_t fetch_add(Value_t& v, Value_t delta){ return __atomic_fetch_add(&v, delta, __ATOMIC_ACQ_REL); }
+    static bool compare_exchange(Value_t& v, Value_t& expected, Value_t desired){
+	return __atomic_compare_exchange_n(&v, &expected, desired, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+};
+
+template <size_t N>
+struct ValueTraits<inline_value<N>>{
+    using Value_t = inline_value<N>;
+    static const bool kAtomic = false;
+
+    static Value_t load(const Value_t& v){ return v; }
+    static void store(Value_t& v, const Value_t& desired){ v = desired; }
+    /* word by word */
+    static Value_t fetch_add(Value_t& v, const Value_t& delta){
+	auto old = v;
+	for(size_t i=0; i<Value_t::kWords; i++)
+	    v.word[i] += delta.word[i];
+	return old;
+    }
+    static bool compare_exchange(Value_t& v, Value_t& expected, const Value_t& desired){
+	if(v == expected){
+	    v = desired;
+	    return true;
+	}
+	expected = v;
+	return false;
+    }
+};
+
+/* the lock that value operations hold on the stripe or segment of their key */
+template <typename Value_t, typename Lock>
+using value_lock = std::conditional_t<ValueTraits<Value_t>::kAtomic, std::shared_lock<Lock>, std::unique_lock<Lock>>;
+
+// engines and benchmarks store VALUE_SIZE-byte values unless told otherwise (make VALUE=32 ...)
+#ifndef VALUE_SIZE
+#define VALUE_SIZE 8
+#endif
+using default_value = std::conditional_t<VALUE_SIZE == sizeof(int64_t), int64_t, inline_value<VALUE_SIZE>>;
+
+#endif  // UTIL_VALUE_TRAITS_H_
@@ -0,0 +1,73 @@
+#ifndef UTIL_WAIT_H_
+#define UTIL_WAIT_H_
+
+#include <cstdint>
+#include <cstddef>
+#include <climits>
+#include <thread>
+#include <immintrin.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+/* Waiting for a resize or a directory doubling. A waiter first spins with pause, doubling the number
+ * of pauses per round up to 2^kSpinRounds, so a short wait costs one cache line and no system call;
+ * once that is used up, backoff yields the core and wait_queue puts the thread to sleep on a futex
+ * until the owner calls wake(). With more threads than cores the waiters then stop taking time slices
+ * from the thread they wait for. */
+class backoff{
+  public:
+    static const int kSpinRounds = 10;
+
+    void pause(void){
+	if(round < kSpinRounds){
+	    for(int i=0; i<(1<<round); i++)
+		_mm_pause();
+	    round++;
+	}
+	else
+	    std::this_thread::yield();
+	asm volatile("" ::: "memory");
+    }
+
+    bool spinning(void) const{ return round < kSpinRounds; }
+    void reset(void){ round = 0; }
+
+  private:
+    int round = 0;
+};
+
+/* Eventcount on a futex word: wait_until(ready) returns once ready() holds, wake() is called by the
+ * thread that makes it hold. A waiter registers in parked and reads seq before its last check of
+ * ready(), so a wake() in between changes seq and the futex call returns right away. */
+class wait_queue{
+  public:
+    template <typename F>
+    void wait_until(F&& ready){
+	backoff b;
+	while(!ready()){
+	    if(b.spinning()){
+		b.pause();
+		continue;
+	    }
+	    __atomic_fetch_add(&parked, 1, __ATOMIC_SEQ_CST);
+	    auto s = __atomic_load_n(&seq, __ATOMIC_SEQ_CST);
+	    if(!ready()){
+		syscall(SYS_futex, &seq, FUTEX_WAIT_PRIVATE, s, nullptr, nullptr, 0);
+	    }
+	    __atomic_fetch_sub(&parked, 1, __ATOMIC_SEQ_CST);
+	}
+    }
+
+    void wake(void){
+	__atomic_fetch_add(&seq, 1, __ATOMIC_SEQ_CST);
+	if(__atomic_load_n(&parked, __ATOMIC_SEQ_CST))
+	    syscall(SYS_futex, &seq, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+  private:
+    alignas(64) int seq = 0;
+    int parked = 0;
+};
+
+#endif  // UTIL_WAIT_H_